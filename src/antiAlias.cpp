@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "main.h"
+#include "frameBuffer.h"
+
+namespace {
+
+const int bandHeight = Frame::tileSize;
+const int maxSubSamples = 16;
+// after this many sub samples a pixel whose samples all agree is left alone
+const int earlySubSamples = 4;
+// sum of channel differences to a neighbour that counts as an edge
+const int edgeThreshold = 24;
+
+int colourDistance(colour8 a, colour8 b) {
+    return std::abs(a.r - b.r) + std::abs(a.g - b.g) + std::abs(a.b - b.b);
+}
+
+bool isEdge(const Frame& source, int x, int y) {
+    colour8 centre = source.pixels[y * source.width + x];
+    const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (auto& offset : offsets) {
+        int nx = x + offset[0], ny = y + offset[1];
+        if (nx < 0 || ny < 0 || nx >= source.width || ny >= source.height) continue;
+        if (colourDistance(centre, source.pixels[ny * source.width + nx]) > edgeThreshold) return true;
+    }
+    return false;
+}
+
+// splitmix64, deterministic jitter per pixel and sample so no generator is shared between workers
+uint64_t hashSample(int x, int y, int i) {
+    uint64_t z = ((uint64_t)(uint32_t)x << 32 | (uint32_t)y) * 0x9e3779b97f4a7c15ull + i;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// position i of a jittered 4x4 grid inside the pixel, the first four cover one cell of each quadrant
+void subSamplePosition(int x, int y, int i, double& sx, double& sy) {
+    static const int order[maxSubSamples] = {0, 10, 8, 2, 5, 15, 13, 7, 1, 11, 9, 3, 4, 14, 12, 6};
+    int cell = order[i];
+    uint64_t h = hashSample(x, y, i);
+    double jx = (h & 0xffffffff) / 4294967296.0;
+    double jy = (h >> 32) / 4294967296.0;
+    // pixel centres sit on integer coordinates, so the pixel spans [-0.5, 0.5)
+    sx = x - 0.5 + (cell % 4 + jx) / 4;
+    sy = y - 0.5 + (cell / 4 + jy) / 4;
+}
+
+void antiAliasBand(MandelJob& job, const Frame& source, int y0, int y1) {
+    const ViewSnapshot& view = job.view;
+    Frame& frame = *job.frame;
+    mpf_t cr, ci, temp;
+    mpf_init2(cr, view.precision);
+    mpf_init2(ci, view.precision);
+    mpf_init2(temp, view.precision);
+    long long iterated = 0;
+    for (int y = y0; y < y1 && !isCancelled(job); y++) {
+        for (int x = 0; x < frame.width; x++) {
+            int index = y * frame.width + x;
+            frame.samples[index] = source.samples[index];
+            frame.pixels[index] = source.pixels[index];
+            if (!isEdge(source, x, y)) continue;
+
+            int sum[3] = {0, 0, 0};
+            int count = 0;
+            bool agree = true;
+            colour8 first;
+            for (; count < maxSubSamples; count++) {
+                if (count == earlySubSamples && agree) break;
+                double sx, sy;
+                subSamplePosition(x, y, count, sx, sy);
+                pixelPosition(view, sx, sy, cr, ci, temp);
+                colour8 colour = sampleColour(computeMandelPosition(cr, ci, view.maxIter, view.precision), view.maxIter, view.gammaval);
+                if (count == 0) first = colour;
+                else if (colourDistance(colour, first) > edgeThreshold) agree = false;
+                sum[0] += colour.r;
+                sum[1] += colour.g;
+                sum[2] += colour.b;
+            }
+            iterated++;
+            frame.pixels[index] = colour8{(uint8_t)(sum[0] / count), (uint8_t)(sum[1] / count), (uint8_t)(sum[2] / count), 255};
+        }
+    }
+    mpf_clear(cr);
+    mpf_clear(ci);
+    mpf_clear(temp);
+    job.pixelsIterated += iterated;
+    if (!isCancelled(job)) frame.markFinal(0, y0, frame.width, y1);
+}
+
+}
+
+// smooth the edges of a finished frame into job's frame. pixels whose colour differs
+// noticeably from a neighbour get up to 16 stratified sub samples averaged, everything else
+// is copied over. samples keep the centre values so later passes still see exact data
+void computeAntiAlias(std::shared_ptr<MandelJob> job, std::shared_ptr<const Frame> source) {
+    // keep showing the aliased image until the smoothed tiles arrive
+    job->frame->publishPreview(std::make_shared<const std::vector<colour8>>(source->pixels));
+    for (int y = 0; y < job->view.sizey; y += bandHeight) {
+        int y1 = std::min(y + bandHeight, job->view.sizey);
+        job->pool.addTask([job, source, y, y1]() { antiAliasBand(*job, *source, y, y1); }, 0);
+    }
+}
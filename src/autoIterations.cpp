@@ -0,0 +1,65 @@
+#include <algorithm>
+#include "main.h"
+#include "frameBuffer.h"
+
+namespace {
+
+const long long minAutoMaxIter = 256;
+const long long maxAutoMaxIter = 1LL << 26;
+// pixels that escaped past half of maxIter, in percent of those that didn't escape at all,
+// that mean black pixels are still turning into detail with more iterations rather than
+// being interior
+const long long tailPercent = 5;
+// deep inside a minibrot's surroundings escape times are counted in its period
+const long long periodsAroundMinibrot = 16;
+// lowering is only worth a full recompute when maxIter is this many times too high
+const long long lowerFactor = 4;
+
+} // namespace
+
+// the maxIter a frame should have had, from its samples and its centre. more than the
+// view's maxIter if pixels were still escaping near the limit or the centre sits in a
+// minibrot whose period maxIter doesn't cover; less if nothing came close to it
+long long suggestMaxIter(const MandelJob& job) {
+    const ViewSnapshot& view = job.view;
+    const std::vector<MandelSample>& samples = job.frame->samples;
+    int width = job.frame->width, height = job.frame->height;
+
+    long long escaped = 0, unescaped = 0, tail = 0, highest = 0;
+    for (const MandelSample& sample : samples) {
+        if (sample.iter >= view.maxIter) {
+            unescaped++;
+            continue;
+        }
+        escaped++;
+        tail += sample.iter > view.maxIter / 2;
+        highest = std::max(highest, sample.iter);
+    }
+    long long border = 0, borderUnescaped = 0;
+    for (int x = 0; x < width; x++) {
+        for (int y : {0, height - 1}) {
+            border++;
+            borderUnescaped += samples[y * width + x].iter >= view.maxIter;
+        }
+    }
+    for (int y = 1; y < height - 1; y++) {
+        for (int x : {0, width - 1}) {
+            border++;
+            borderUnescaped += samples[y * width + x].iter >= view.maxIter;
+        }
+    }
+
+    long long suggested = view.maxIter;
+    if (unescaped > 0 && tail * 100 >= unescaped * tailPercent) suggested = view.maxIter * 2;
+    // a black centre and mostly black border: the centre's minibrot decides how many
+    // iterations its surroundings need, found with the ball method over the view
+    const MandelSample& centre = samples[height / 2 * width + width / 2];
+    if (centre.iter >= view.maxIter && borderUnescaped * 2 > border) {
+        long long period = ballPeriod(view.offsetx, view.offsety, mpf_class(view.zoom / 2, view.precision), view.maxIter);
+        if (period > 0) suggested = std::max(suggested, period * periodsAroundMinibrot);
+    }
+    if (suggested == view.maxIter && (unescaped == 0 || tail == 0) && highest * lowerFactor < view.maxIter) {
+        suggested = highest * 2;
+    }
+    return std::clamp(suggested, minAutoMaxIter, maxAutoMaxIter);
+}
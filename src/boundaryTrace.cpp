@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <vector>
+#include "main.h"
+#include "frameBuffer.h"
+
+namespace {
+
+const int traceTileSize = 64;
+
+enum : uint8_t {
+    Loaded = 1,
+    Queued = 2
+};
+
+// boundary tracing over one tile: starting from the tile edges, every evaluated pixel that
+// differs from one of its neighbours pulls that neighbour (and the diagonals between them)
+// into the queue, so only the contours between iteration bands get iterated. whatever is
+// left unloaded afterwards is enclosed by a single band and is filled scanline by scanline
+class TileTracer {
+public:
+    TileTracer(MandelJob& job, int x0, int y0, int x1, int y1)
+        : job(job)
+        , view(job.view)
+        , frame(*job.frame)
+        , x0(x0)
+        , y0(y0)
+        , width(x1 - x0)
+        , height(y1 - y0)
+        , state(width * height, 0) {
+        mpf_init2(cr, view.precision);
+        mpf_init2(ci, view.precision);
+        mpf_init2(temp, view.precision);
+    }
+
+    ~TileTracer() {
+        mpf_clear(cr);
+        mpf_clear(ci);
+        mpf_clear(temp);
+    }
+
+    bool run() {
+        for (int x = 0; x < width; x++) {
+            addQueue(x);
+            addQueue((height - 1) * width + x);
+        }
+        for (int y = 1; y < height - 1; y++) {
+            addQueue(y * width);
+            addQueue(y * width + width - 1);
+        }
+
+        while (!queue.empty()) {
+            if (isCancelled(job)) return false;
+            int p = queue.back();
+            queue.pop_back();
+            scan(p);
+        }
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 1; x < width; x++) {
+                int p = y * width + x;
+                if (state[p] & Loaded) continue;
+                storeSample(job, x0 + x, y0 + y, sampleAt(p - 1));
+                state[p] |= Loaded;
+            }
+        }
+        job.pixelsIterated += iterated;
+        return true;
+    }
+
+private:
+    MandelSample sampleAt(int p) const {
+        return frame.samples[(y0 + p / width) * frame.width + x0 + p % width];
+    }
+
+    long long load(int p) {
+        if (!(state[p] & Loaded)) {
+            int x = x0 + p % width;
+            int y = y0 + p / width;
+            storeSample(job, x, y, evaluatePixel(job, x, y, cr, ci, temp, iterated));
+            state[p] |= Loaded;
+        }
+        return sampleAt(p).iter;
+    }
+
+    void addQueue(int p) {
+        if (state[p] & Queued) return;
+        state[p] |= Queued;
+        queue.push_back(p);
+    }
+
+    void scan(int p) {
+        int x = p % width;
+        int y = p / width;
+        long long centre = load(p);
+        bool ll = x > 0, rr = x < width - 1, dd = y > 0, uu = y < height - 1;
+        bool l = ll && load(p - 1) != centre;
+        bool r = rr && load(p + 1) != centre;
+        bool d = dd && load(p - width) != centre;
+        bool u = uu && load(p + width) != centre;
+        if (l) addQueue(p - 1);
+        if (r) addQueue(p + 1);
+        if (d) addQueue(p - width);
+        if (u) addQueue(p + width);
+        // the diagonals keep contours that run at 45 degrees connected
+        if (dd && ll && (l || d)) addQueue(p - width - 1);
+        if (dd && rr && (r || d)) addQueue(p - width + 1);
+        if (uu && ll && (l || u)) addQueue(p + width - 1);
+        if (uu && rr && (r || u)) addQueue(p + width + 1);
+    }
+
+    MandelJob& job;
+    const ViewSnapshot& view;
+    Frame& frame;
+    int x0, y0, width, height;
+    std::vector<uint8_t> state;
+    std::vector<int> queue;
+    long long iterated = 0;
+    mpf_t cr, ci, temp;
+};
+
+}
+
+// the frame is split into tiles that are traced independently on the pool. each tile seeds
+// the queue with its own edges, which are the seams to its neighbours, so a contour crossing
+// a seam is picked up again on the other side and no fill ever leaks across a tile boundary
+bool computeMandelBoundaryTrace(std::shared_ptr<MandelJob> job) {
+    int width = job->view.sizex;
+    int height = job->view.sizey;
+    for (int y = 0; y < height; y += traceTileSize) {
+        for (int x = 0; x < width; x += traceTileSize) {
+            int x1 = std::min(x + traceTileSize, width);
+            int y1 = std::min(y + traceTileSize, height);
+            job->pool.addTask([=]() {
+                TileTracer tracer(*job, x, y, x1, y1);
+                if (tracer.run()) job->frame->markFinal(x, y, x1, y1);
+            }, focusPriority(job->view, x, y, x1, y1));
+        }
+    }
+    return true;
+}
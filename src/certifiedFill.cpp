@@ -0,0 +1,81 @@
+#include <cmath>
+#include "main.h"
+
+// iterates every point of the rectangle with corners (x0, y0) and (x1, y1) inclusive at once, at
+// the view's precision. the rectangle lies in the disk c0 + d, |d| <= r, around its centre, and
+// z_n(c0 + d) = Z_n + A_n d + e_n with Z_n the orbit of c0, A_n its dz/dc and |e_n| <= E_n, so
+// z_n is within |A_n| r + E_n of Z_n. returns the iteration every point of the rectangle escapes
+// at, maxIter if provably none of them escapes before maxIter, or -1 if they don't all behave
+// the same. mpf doesn't round outwards, every bound is widened by far more than a step's
+// rounding error instead.
+// at iterations 2^k - 1 the disk the orbit is in is iterated on as a set as well: once it maps
+// into itself for every c in the rectangle, all of the rectangle's orbits stay bounded forever
+long long certifyRect(const ViewSnapshot& view, int x0, int y0, int x1, int y1) {
+    unsigned long precision = view.precision;
+    mpf_t centrer, centrei, position;
+    mpf_init2(centrer, precision);
+    mpf_init2(centrei, precision);
+    mpf_init2(position, precision);
+    pixelPosition(view, (x0 + x1) / 2.0, (y0 + y1) / 2.0, centrer, centrei, position);
+    mpf_class cr(centrer, precision), ci(centrei, precision);
+    mpf_clear(position);
+    mpf_clear(centrei);
+    mpf_clear(centrer);
+
+    // |z| stays below 2 and |c| is small, rounding errors are a few ulps of 4
+    mpf_class pad(1, precision);
+    mpf_div_2exp(pad.get_mpf_t(), pad.get_mpf_t(), precision - 8);
+    mpf_class escapeLow(2 - pad, precision), escapeHigh(2 + pad, precision);
+    mpf_class r(std::hypot(x1 - x0, y1 - y0) / 2 * view.zoom / view.sizex + pad, precision);
+
+    mpf_class zr(0, precision), zi(0, precision), ar(0, precision), ai(0, precision), error(0, precision);
+    mpf_class magnitude(0, precision), radius(0, precision), temp(0, precision);
+    // the disk (sr, si) + s kept at the last checkpoint and its image (wr, wi) + w under the
+    // iterations since, while that image stayed inside |z| <= 2
+    mpf_class sr(0, precision), si(0, precision), s(0, precision);
+    mpf_class wr(0, precision), wi(0, precision), w(0, precision);
+    bool checkpoint = false;
+
+    for (long long iter = 0; iter < view.maxIter; iter++) {
+        // (Z + A d + e)^2 + c0 + d: the error picks up 2 Z e and (A d + e)^2
+        magnitude = sqrt(zr * zr + zi * zi);
+        radius = sqrt(ar * ar + ai * ai) * r + error;
+        error = 2 * magnitude * error + radius * radius + pad;
+        temp = 2 * (zr * ar - zi * ai) + 1;
+        ai = 2 * (zr * ai + zi * ar);
+        ar = temp;
+        temp = zr * zr - zi * zi + cr;
+        zi = 2 * zr * zi + ci;
+        zr = temp;
+
+        magnitude = sqrt(zr * zr + zi * zi);
+        radius = sqrt(ar * ar + ai * ai) * r + error;
+        temp = magnitude - radius;
+        // that was z_{iter + 1}, the kernel counts the n of the first |z_n| > 2
+        if (cmp(temp, escapeHigh) > 0) return iter + 1;
+        temp = magnitude + radius;
+        if (cmp(temp, escapeLow) > 0) return -1;
+
+        if (checkpoint) {
+            // {w^2 + c} for w in the disk and c in the rectangle's disk
+            w = (2 * sqrt(wr * wr + wi * wi) + w) * w + r + pad;
+            temp = wr * wr - wi * wi + cr;
+            wi = 2 * wr * wi + ci;
+            wr = temp;
+            temp = sqrt(wr * wr + wi * wi) + w;
+            if (cmp(temp, escapeLow) > 0) {
+                checkpoint = false;
+            } else {
+                temp = hypot(wr - sr, wi - si) + w + pad;
+                if (cmp(temp, s) <= 0) return view.maxIter;
+            }
+        }
+        if (((iter + 1) & iter) == 0) {
+            sr = wr = zr;
+            si = wi = zi;
+            s = w = radius;
+            checkpoint = true;
+        }
+    }
+    return view.maxIter;
+}
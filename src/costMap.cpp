@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cmath>
+#include "costMap.h"
+#include "frameBuffer.h"
+
+namespace {
+
+// every pixel of the old frame is looked up in a grid this coarse, plenty for a prediction
+const int sampleStep = 2;
+// below this share of the new frame covered by the old one there is nothing to go on
+const double minCoverage = 0.25;
+
+} // namespace
+
+CostMap::CostMap(const Frame& previous, const ViewSnapshot& previousView, const ViewSnapshot& view) {
+    double scale, dx, dy;
+    if (!viewProjection(previousView, view, scale, dx, dy)) return;
+    int width = view.sizex, height = view.sizey;
+    int blockColumns = (width + blockSize - 1) / blockSize;
+    int blockRows = (height + blockSize - 1) / blockSize;
+
+    std::vector<double> blockCost((size_t)blockColumns * blockRows, 0);
+    std::vector<int> blockKnown((size_t)blockColumns * blockRows, 0);
+    double total = 0;
+    long long known = 0, sampled = 0;
+    for (int y = 0; y < height; y += sampleStep) {
+        int sourceY = (int)std::lround(scale * y + dy);
+        for (int x = 0; x < width; x += sampleStep) {
+            sampled++;
+            int sourceX = (int)std::lround(scale * x + dx);
+            if (sourceX < 0 || sourceX >= width || sourceY < 0 || sourceY >= height) continue;
+            long long iter = previous.samples[(size_t)sourceY * width + sourceX].iter;
+            double iterations = iter >= previousView.maxIter ? view.maxIter : std::min(iter, view.maxIter);
+            size_t block = (size_t)(y / blockSize) * blockColumns + x / blockSize;
+            blockCost[block] += iterations;
+            blockKnown[block]++;
+            total += iterations;
+            known++;
+        }
+    }
+    if (known < minCoverage * sampled) return;
+
+    // a block costs the mean of its samples times its pixels, the frame's mean where it has none
+    double mean = total / known;
+    columns = blockColumns;
+    rows = blockRows;
+    sums.assign((size_t)(columns + 1) * (rows + 1), 0);
+    for (int by = 0; by < rows; by++) {
+        int blockHeight = std::min(blockSize, height - by * blockSize);
+        double row = 0;
+        for (int bx = 0; bx < columns; bx++) {
+            int blockWidth = std::min(blockSize, width - bx * blockSize);
+            size_t block = (size_t)by * columns + bx;
+            double perPixel = blockKnown[block] ? blockCost[block] / blockKnown[block] : mean;
+            row += perPixel * blockWidth * blockHeight;
+            sums[(size_t)(by + 1) * (columns + 1) + bx + 1] = sums[(size_t)by * (columns + 1) + bx + 1] + row;
+        }
+    }
+}
+
+double CostMap::cost(int x0, int y0, int x1, int y1) const {
+    auto column = [&](int x) { return std::clamp((x + blockSize / 2) / blockSize, 0, columns); };
+    auto row = [&](int y) { return std::clamp((y + blockSize / 2) / blockSize, 0, rows); };
+    int bx0 = column(x0), bx1 = column(x1), by0 = row(y0), by1 = row(y1);
+    auto at = [&](int bx, int by) { return sums[(size_t)by * (columns + 1) + bx]; };
+    return at(bx1, by1) - at(bx0, by1) - at(bx1, by0) + at(bx0, by0);
+}
@@ -0,0 +1,28 @@
+#ifndef COST_MAP_H
+#define COST_MAP_H
+
+#include <vector>
+#include "main.h"
+
+// expected iterations per block of a new frame, predicted from the last finished frame projected
+// into the new view: a pixel costs what it took there, maxIter of the new view if it didn't
+// escape. parts the old frame doesn't cover cost its average. kept as a summed area table,
+// the cost of any rectangle is four lookups
+class CostMap {
+public:
+    static constexpr int blockSize = 8;
+
+    // empty if the views are too far apart or share too little to predict anything
+    CostMap(const Frame& previous, const ViewSnapshot& previousView, const ViewSnapshot& view);
+
+    bool empty() const { return sums.empty(); }
+    // [x0, x1) x [y0, y1), to the nearest block edges
+    double cost(int x0, int y0, int x1, int y1) const;
+
+private:
+    int columns = 0;
+    int rows = 0;
+    std::vector<double> sums; // (columns + 1) x (rows + 1), zero first row and column
+};
+
+#endif
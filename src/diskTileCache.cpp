@@ -0,0 +1,172 @@
+#include "diskTileCache.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DiskTileCache::DiskTileCache(std::string path, size_t maxBytes)
+    : path(std::move(path))
+    , maxBytes(maxBytes) {
+    if (!open()) {
+        std::cout << "tile cache: can't use " << this->path << ", continuing without it" << std::endl;
+        close();
+    }
+}
+
+DiskTileCache::~DiskTileCache() {
+    close();
+}
+
+// fnv-1a over the key and the sample bytes
+uint64_t DiskTileCache::checksum(const std::string& key, const MandelSample* samples, size_t sampleCount) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const unsigned char* bytes, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    };
+    add((const unsigned char*)key.data(), key.size());
+    add((const unsigned char*)samples, sampleCount * sizeof(MandelSample));
+    return hash;
+}
+
+bool DiskTileCache::open() {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0) return false;
+    fileSize = status.st_size;
+
+    uint32_t header[4] = {fileMagic, version, (uint32_t)sizeof(MandelSample), 0};
+    uint32_t existing[4];
+    if (fileSize < fileHeaderSize || pread(fd, existing, fileHeaderSize, 0) != (ssize_t)fileHeaderSize
+        || std::memcmp(existing, header, fileHeaderSize) != 0) {
+        // new, foreign or from an incompatible build, start over
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, header, fileHeaderSize, 0) != (ssize_t)fileHeaderSize) return false;
+        fileSize = fileHeaderSize;
+    }
+    if (!map()) return false;
+    scan();
+    return true;
+}
+
+void DiskTileCache::close() {
+    if (mapping) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    index.clear();
+}
+
+// reserve address space for the whole capped file once, appends show up in the shared
+// mapping without remapping. pages past the end of the file are never touched
+bool DiskTileCache::map() {
+    mappingSize = std::max<size_t>(maxBytes * 2, fileSize);
+    void* address = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) return false;
+    mapping = (char*)address;
+    return true;
+}
+
+// rebuild the index from the record headers, the sample data is only checked on first use.
+// anything after the first malformed record is a torn write and gets cut off
+void DiskTileCache::scan() {
+    uint64_t offset = fileHeaderSize;
+    while (offset + sizeof(RecordHeader) <= fileSize) {
+        RecordHeader header;
+        std::memcpy(&header, mapping + offset, sizeof(header));
+        if (header.magic != recordMagic || header.keyLength == 0 || header.keyLength > 4096) break;
+        uint64_t size = recordSize(header.keyLength, header.sampleCount);
+        if (offset + size > fileSize) break;
+        std::string key(mapping + offset + sizeof(RecordHeader), header.keyLength);
+        // a later record for the same key replaces the earlier one
+        index[key] = {offset, header.sampleCount};
+        offset += size;
+    }
+    if (offset != fileSize) {
+        if (ftruncate(fd, offset) == 0) fileSize = offset;
+    }
+}
+
+bool DiskTileCache::contains(const std::string& key) const {
+    return index.count(key) != 0;
+}
+
+const MandelSample* DiskTileCache::find(const std::string& key, size_t sampleCount) {
+    auto it = index.find(key);
+    if (it == index.end()) return nullptr;
+    Entry& entry = it->second;
+    if (entry.sampleCount != sampleCount) return nullptr;
+    const char* record = mapping + entry.offset;
+    const MandelSample* samples = (const MandelSample*)(record + sizeof(RecordHeader) + keySpace(key.size()));
+    if (!entry.verified) {
+        RecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        if (header.checksum != checksum(key, samples, sampleCount)) {
+            index.erase(it);
+            return nullptr;
+        }
+        entry.verified = true;
+    }
+    entry.lastUsed = ++useCounter;
+    return samples;
+}
+
+void DiskTileCache::append(const std::string& key, const std::vector<MandelSample>& samples) {
+    if (fd < 0) return;
+    size_t size = recordSize(key.size(), samples.size());
+    if (fileSize + size > maxBytes) {
+        compact();
+        if (fd < 0 || fileSize + size > maxBytes) return;
+    }
+
+    // one write per record, a crash can only leave a torn record at the end
+    std::vector<char> record(size, 0);
+    RecordHeader header{recordMagic, (uint32_t)key.size(), (uint32_t)samples.size(), 0,
+                        checksum(key, samples.data(), samples.size())};
+    std::memcpy(record.data(), &header, sizeof(header));
+    std::memcpy(record.data() + sizeof(header), key.data(), key.size());
+    std::memcpy(record.data() + sizeof(header) + keySpace(key.size()), samples.data(), samples.size() * sizeof(MandelSample));
+    if (pwrite(fd, record.data(), size, fileSize) != (ssize_t)size) {
+        // leave the file as it was, the partial record is overwritten by the next append
+        return;
+    }
+    index[key] = {fileSize, (uint32_t)samples.size(), true, ++useCounter};
+    fileSize += size;
+}
+
+// keep the most recently used half of the cap, written to a new file that replaces the old
+// one with rename so a crash leaves either the old or the new file, never a mix
+void DiskTileCache::compact() {
+    std::vector<std::pair<std::string, Entry>> entries(index.begin(), index.end());
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.second.lastUsed > b.second.lastUsed; });
+
+    std::string temporaryPath = path + ".tmp";
+    int temporary = ::open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (temporary < 0) return;
+    uint32_t fileHeader[4] = {fileMagic, version, (uint32_t)sizeof(MandelSample), 0};
+    bool ok = write(temporary, fileHeader, fileHeaderSize) == (ssize_t)fileHeaderSize;
+    uint64_t written = fileHeaderSize;
+    for (const auto& [key, entry] : entries) {
+        if (!ok) break;
+        size_t size = recordSize(key.size(), entry.sampleCount);
+        if (written + size > maxBytes / 2) break;
+        ok = write(temporary, mapping + entry.offset, size) == (ssize_t)size;
+        written += size;
+    }
+    ok = ok && fsync(temporary) == 0;
+    ::close(temporary);
+    if (!ok || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        return;
+    }
+
+    close();
+    if (!open()) {
+        std::cout << "tile cache: reopening " << path << " failed, continuing without it" << std::endl;
+        close();
+    }
+}
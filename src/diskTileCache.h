@@ -0,0 +1,72 @@
+#ifndef DISK_TILE_CACHE_H
+#define DISK_TILE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "main.h"
+
+// persistent tile store behind TileCache. one append-only file of records (header, key,
+// samples), mapped read-only so cached tiles are copied straight out of the page cache.
+// every record carries a checksum that is verified on first use, and opening the file cuts
+// off a torn record left by a crash. once the file outgrows its cap the most recently used
+// records are compacted into a new file that atomically replaces the old one. only used
+// from the render coordinator thread
+class DiskTileCache {
+public:
+    DiskTileCache(std::string path, size_t maxBytes);
+    ~DiskTileCache();
+
+    bool isOpen() const { return fd >= 0; }
+
+    // samples of a tile, pointing into the mapping, or nullptr
+    const MandelSample* find(const std::string& key, size_t sampleCount);
+    bool contains(const std::string& key) const;
+    void append(const std::string& key, const std::vector<MandelSample>& samples);
+
+private:
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t keyLength;
+        uint32_t sampleCount;
+        uint32_t reserved;
+        uint64_t checksum;
+    };
+
+    struct Entry {
+        uint64_t offset; // of the record header
+        uint32_t sampleCount;
+        bool verified = false;
+        uint64_t lastUsed = 0;
+    };
+
+    static constexpr uint32_t fileMagic = 0x4d444c43;   // file header
+    static constexpr uint32_t recordMagic = 0x4d54494c; // every record
+    static constexpr uint32_t version = 2; // 2: samples carry a distance estimate
+    static constexpr size_t fileHeaderSize = 16;
+
+    static size_t keySpace(size_t keyLength) { return (keyLength + 7) & ~size_t(7); }
+    static size_t recordSize(size_t keyLength, size_t sampleCount) {
+        return sizeof(RecordHeader) + keySpace(keyLength) + sampleCount * sizeof(MandelSample);
+    }
+    static uint64_t checksum(const std::string& key, const MandelSample* samples, size_t sampleCount);
+
+    bool open();
+    void close();
+    bool map();
+    void scan();
+    void compact();
+
+    std::string path;
+    size_t maxBytes;
+    int fd = -1;
+    uint64_t fileSize = 0;
+    char* mapping = nullptr;
+    size_t mappingSize = 0;
+    uint64_t useCounter = 0;
+    std::unordered_map<std::string, Entry> index;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "main.h"
+
+// one frame of output. workers write pixels and then report them final with markFinal,
+// once every pixel of a tile is final its bit in the completion bitmap is set. after that
+// no worker touches the tile again, so the display may read it while the rest still renders
+class Frame {
+public:
+    static constexpr int tileSize = 32;
+
+    Frame(int width, int height)
+        : width(width)
+        , height(height)
+        , tilesX((width + tileSize - 1) / tileSize)
+        , tilesY((height + tileSize - 1) / tileSize)
+        , pixels(width * height)
+        , samples(width * height)
+        , orbits(width * height)
+        , tileRemaining(new std::atomic<int>[tilesX * tilesY])
+        , tileDone(new std::atomic<uint64_t>[numTileWords()]) {
+        reset(0);
+    }
+
+    // reuse the allocation for a new frame of the same size, old pixel contents are left
+    // in place but can't be observed since no tile is marked done
+    void reset(long long unsigned int newFrameID) {
+        frameID = newFrameID;
+        for (auto& orbit : orbits) orbit.reset();
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                tileRemaining[ty * tilesX + tx].store(tileWidth(tx) * tileHeight(ty), std::memory_order_relaxed);
+            }
+        }
+        for (int i = 0; i < numTileWords(); i++) {
+            tileDone[i].store(0, std::memory_order_relaxed);
+        }
+        completedTiles.store(0, std::memory_order_release);
+        preview.store(nullptr, std::memory_order_relaxed);
+        previewGeneration.store(0, std::memory_order_release);
+    }
+
+    // pixels in [x0, x1) x [y0, y1) have been written for the last time
+    void markFinal(int x0, int y0, int x1, int y1) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width);
+        y1 = std::min(y1, height);
+        if (x0 >= x1 || y0 >= y1) return;
+        for (int ty = y0 / tileSize; ty <= (y1 - 1) / tileSize; ty++) {
+            int overlapY = std::min(y1, (ty + 1) * tileSize) - std::max(y0, ty * tileSize);
+            for (int tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++) {
+                int overlapX = std::min(x1, (tx + 1) * tileSize) - std::max(x0, tx * tileSize);
+                int tile = ty * tilesX + tx;
+                int area = overlapX * overlapY;
+                // acq_rel so whoever finishes the tile also sees every other writer's pixels
+                if (tileRemaining[tile].fetch_sub(area, std::memory_order_acq_rel) == area) {
+                    tileDone[tile / 64].fetch_or(uint64_t(1) << (tile % 64), std::memory_order_release);
+                    long long unsigned int completed = completedTiles.fetch_add(1, std::memory_order_acq_rel) + 1;
+                    if (onTileDone) onTileDone();
+                    if (completed == (long long unsigned int)(tilesX * tilesY) && onComplete) onComplete();
+                }
+            }
+        }
+    }
+
+    // a full frame placeholder image for the display to show until the tiles are done,
+    // immutable once published so it can be read without any synchronisation
+    void publishPreview(std::shared_ptr<const std::vector<colour8>> image) {
+        preview.store(std::move(image), std::memory_order_release);
+        previewGeneration.fetch_add(1, std::memory_order_acq_rel);
+        if (onTileDone) onTileDone();
+    }
+
+    std::shared_ptr<const std::vector<colour8>> acquirePreview() const {
+        return preview.load(std::memory_order_acquire);
+    }
+
+    long long unsigned int previewVersion() const {
+        return previewGeneration.load(std::memory_order_acquire);
+    }
+
+    bool isTileDone(int tile) const {
+        return tileDone[tile / 64].load(std::memory_order_acquire) & (uint64_t(1) << (tile % 64));
+    }
+
+    uint64_t tileDoneWord(int word) const {
+        return tileDone[word].load(std::memory_order_acquire);
+    }
+
+    int numTileWords() const {
+        return (tilesX * tilesY + 63) / 64;
+    }
+
+    // increases every time a tile completes, the display compares it to skip idle frames
+    long long unsigned int generation() const {
+        return completedTiles.load(std::memory_order_acquire);
+    }
+
+    bool isComplete() const {
+        return generation() == (long long unsigned int)(tilesX * tilesY);
+    }
+
+    int tileWidth(int tx) const {
+        return std::min(tileSize, width - tx * tileSize);
+    }
+
+    int tileHeight(int ty) const {
+        return std::min(tileSize, height - ty * tileSize);
+    }
+
+    const int width;
+    const int height;
+    const int tilesX;
+    const int tilesY;
+    long long unsigned int frameID = 0;
+    std::vector<colour8> pixels;
+    std::vector<MandelSample> samples;
+    // where the orbits of unescaped iterated pixels stopped, empty for everything else
+    std::vector<std::unique_ptr<OrbitState>> orbits;
+    // called from whichever worker finishes a tile, must be thread safe and cheap
+    std::function<void()> onTileDone;
+    // called once by the worker that finishes the last tile, never for a cancelled frame
+    std::function<void()> onComplete;
+
+private:
+    std::unique_ptr<std::atomic<int>[]> tileRemaining;
+    std::unique_ptr<std::atomic<uint64_t>[]> tileDone;
+    std::atomic<long long unsigned int> completedTiles;
+    std::atomic<std::shared_ptr<const std::vector<colour8>>> preview;
+    std::atomic<long long unsigned int> previewGeneration;
+};
+
+// hands frames from the render coordinator to the display. every frame gets its own back
+// buffer for the workers, the newest one is published atomically and the display acquires
+// it without ever blocking the workers. buffers are recycled once nobody references them
+// any more (not published, not held by the display, no straggling tasks of a cancelled frame)
+class FrameBuffer {
+public:
+    // only called from the coordinator thread
+    std::shared_ptr<Frame> beginFrame(int width, int height, long long unsigned int frameID) {
+        std::shared_ptr<Frame> frame;
+        for (auto it = frames.begin(); it != frames.end(); ++it) {
+            if (it->use_count() != 1) continue;
+            if ((*it)->width == width && (*it)->height == height) {
+                frame = *it;
+                break;
+            }
+        }
+        if (!frame) {
+            // drop unused buffers of the wrong size before growing past the usual three
+            std::erase_if(frames, [](const std::shared_ptr<Frame>& f) { return f.use_count() == 1; });
+            frame = std::make_shared<Frame>(width, height);
+            frames.push_back(frame);
+        }
+        frame->reset(frameID);
+        frame->onTileDone = tileListener;
+        frame->onComplete = nullptr;
+        published.store(frame, std::memory_order_release);
+        return frame;
+    }
+
+    // lets the display sleep until there is something new to show
+    void setTileListener(std::function<void()> listener) {
+        tileListener = std::move(listener);
+    }
+
+    // newest frame, possibly still rendering; only tiles marked done may be read
+    std::shared_ptr<Frame> acquire() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<std::shared_ptr<Frame>> frames;
+    std::atomic<std::shared_ptr<Frame>> published;
+    std::function<void()> tileListener;
+};
+
+#endif
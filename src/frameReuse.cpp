@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include "main.h"
+#include "frameBuffer.h"
+
+// where the pixels of `to` are in `from`'s pixel coordinates: pixel (x, y) of `to` is at
+// (scale * x + dx, scale * y + dy). false when the two are too far apart to be related
+bool viewProjection(const ViewSnapshot& from, const ViewSnapshot& to, double& scale, double& dx, double& dy) {
+    if (from.sizex != to.sizex || from.sizey != to.sizey) return false;
+    mpf_class ratio(to.zoom / from.zoom, to.precision);
+    scale = ratio.get_d();
+    if (scale > maxReuseScale || scale < 1.0 / maxReuseScale) return false;
+
+    // (x - W/2) / W * zoom is the position of pixel x relative to the offset, solving
+    // from's position = to's position for from's pixel gives the linear map
+    mpf_class pixelSize(from.zoom / from.sizex, to.precision);
+    mpf_class shiftx((to.offsetx - from.offsetx) / pixelSize, to.precision);
+    mpf_class shifty((to.offsety - from.offsety) / pixelSize, to.precision);
+    dx = shiftx.get_d() + (1 - scale) * to.sizex / 2.0;
+    dy = shifty.get_d() + (1 - scale) * to.sizey / 2.0;
+    return std::abs(dx) < 2.0 * maxReuseScale * to.sizex && std::abs(dy) < 2.0 * maxReuseScale * to.sizey;
+}
+
+// identical pixel positions and colouring, only maxIter may differ
+bool sameViewport(const ViewSnapshot& from, const ViewSnapshot& to) {
+    return from.sizex == to.sizex && from.sizey == to.sizey
+        && from.gammaval == to.gammaval && from.accurateColouring == to.accurateColouring
+        && from.distanceEstimation == to.distanceEstimation && from.certifiedFill == to.certifiedFill
+        && cmp(from.zoom, to.zoom) == 0 && cmp(from.offsetx, to.offsetx) == 0 && cmp(from.offsety, to.offsety) == 0;
+}
+
+// whether pixels of `to` land exactly on pixels of `from`: same iteration settings, `to`
+// zoomed out by a whole factor and the offsets differing by whole pixels. a plain pan has scale 1
+bool pixelMapping(const ViewSnapshot& from, const ViewSnapshot& to, PixelMapping& mapping) {
+    if (from.maxIter != to.maxIter || from.gammaval != to.gammaval) return false;
+    if (from.accurateColouring != to.accurateColouring) return false;
+    if (from.distanceEstimation != to.distanceEstimation || from.certifiedFill != to.certifiedFill) return false;
+    double scale, dx, dy;
+    if (!viewProjection(from, to, scale, dx, dy)) return false;
+    mapping.scale = (int)std::lround(scale);
+    mapping.dx = (int)std::lround(dx);
+    mapping.dy = (int)std::lround(dy);
+    if (mapping.scale < 1 || std::abs(scale - mapping.scale) > 1e-9) return false;
+    return std::abs(dx - mapping.dx) < 1e-3 && std::abs(dy - mapping.dy) < 1e-3;
+}
+
+// placeholder for the parts of a view that can't be reused exactly, all of a zoom in or the
+// surround of a zoom out: the old frame magnified (or shrunk) into place with nearest
+// neighbour lookups, black where it has no data. published as the preview, the real tiles
+// replace it as they finish
+void publishReprojection(MandelJob& job, const Frame& source, const ViewSnapshot& sourceView) {
+    double scale, dx, dy;
+    if (!viewProjection(sourceView, job.view, scale, dx, dy)) return;
+    int width = job.frame->width, height = job.frame->height;
+    auto preview = std::make_shared<std::vector<colour8>>((size_t)width * height, colour8{0, 0, 0, 255});
+    std::vector<int> columns(width);
+    for (int x = 0; x < width; x++) {
+        columns[x] = (int)std::lround(scale * x + dx);
+    }
+    for (int y = 0; y < height; y++) {
+        int sourceY = (int)std::lround(scale * y + dy);
+        if (sourceY < 0 || sourceY >= height) continue;
+        for (int x = 0; x < width; x++) {
+            if (columns[x] < 0 || columns[x] >= width) continue;
+            (*preview)[(size_t)y * width + x] = source.pixels[(size_t)sourceY * width + columns[x]];
+        }
+    }
+    job.frame->publishPreview(std::move(preview));
+}
+
+namespace {
+
+// the range of new pixels c with 0 <= scale * c + d < size, as [first, last)
+void keptRange(int size, int scale, int d, int& first, int& last) {
+    // ceil(-d / scale) and floor((size - 1 - d) / scale) + 1 for either sign of d
+    first = std::max(0, (int)std::ceil(-(double)d / scale));
+    last = std::min(size, (int)std::floor((double)(size - 1 - d) / scale) + 1);
+    last = std::max(first, last);
+}
+
+}
+
+// copy every pixel that exists in a finished frame under the mapping and mark it final.
+// the reused part is a rectangle, returns the up to four strips around it that are left
+// to compute: a pan exposes one or two edges, a zoom out everything but the centre
+std::vector<ScreenRect> reuseFrame(MandelJob& job, const Frame& source, const PixelMapping& mapping) {
+    Frame& frame = *job.frame;
+    int width = frame.width, height = frame.height;
+    ScreenRect kept;
+    keptRange(width, mapping.scale, mapping.dx, kept.x0, kept.x1);
+    keptRange(height, mapping.scale, mapping.dy, kept.y0, kept.y1);
+    if (kept.x0 == kept.x1 || kept.y0 == kept.y1) return {{0, 0, width, height}};
+
+    for (int y = kept.y0; y < kept.y1; y++) {
+        size_t sourceRow = (size_t)(mapping.scale * y + mapping.dy) * width;
+        for (int x = kept.x0; x < kept.x1; x++) {
+            size_t from = sourceRow + mapping.scale * x + mapping.dx;
+            frame.samples[(size_t)y * width + x] = source.samples[from];
+            frame.pixels[(size_t)y * width + x] = source.pixels[from];
+            if (source.orbits[from]) {
+                frame.orbits[(size_t)y * width + x] = std::make_unique<OrbitState>(*source.orbits[from]);
+            }
+        }
+    }
+
+    // full height strips at the left and right, then the bottom and top strips between them
+    std::vector<ScreenRect> exposed;
+    if (kept.x0 > 0) exposed.push_back({0, 0, kept.x0, height});
+    if (kept.x1 < width) exposed.push_back({kept.x1, 0, width, height});
+    if (kept.y0 > 0) exposed.push_back({kept.x0, 0, kept.x1, kept.y0});
+    if (kept.y1 < height) exposed.push_back({kept.x0, kept.y1, kept.x1, height});
+
+    // last, a reused frame with nothing exposed completes right here
+    frame.markFinal(kept.x0, kept.y0, kept.x1, kept.y1);
+    return exposed;
+}
@@ -5,8 +5,8 @@
 #include <gmp.h>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <cstdint>
-#include <random>
 #include <sstream>
 #include <sys/types.h>
 #include <thread>
@@ -15,24 +15,28 @@
 #include <gmpxx.h>
 #include "render.h"
 #include "main.h"
+#include "frameBuffer.h"
+#include "referenceOrbit.h"
+#include "costMap.h"
 
 int printThreshold;
 int errorcount = 0;
 std::atomic<long long unsigned int> globalMandelFrameID = 0; 
 
-std::random_device rd;
-std::mt19937 g(rd());
-
 void writeRawImg(std::int32_t width, std::int32_t height, const std::vector<colour8>& data) {
     std::stringstream header;
     header << "P6 " << width << " " << height << " 255\n";
 
-    std::ofstream file("mandel.ppm");
+    // frames are stored bottom row first like the texture, ppm wants the top row first
+    std::ofstream file("mandel.ppm", std::ios::binary);
     file << header.str();
-    for (int i = 0; i < data.size(); i++) {
-        file.put(data[i].r);
-        file.put(data[i].g);
-        file.put(data[i].b);
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = 0; x < width; x++) {
+            const colour8& pixel = data[y * width + x];
+            file.put(pixel.r);
+            file.put(pixel.g);
+            file.put(pixel.b);
+        }
     }
     file.close();
 }
@@ -51,39 +55,105 @@ void mandelIterate(mpf_t zr, mpf_t zi, const mpf_t cr, const mpf_t ci, mpf_t zrs
     mpf_add(zi, temp, ci);
 }
 
-HSVd computeMandelPosition(mpf_t cr, mpf_t ci, mpf_t zoom, long long maxIter, double gammaval, mpf_t temp, bool accurateColouring) {
-    mpf_t zr, zi, zrsqu, zisqu, z2rsqu, z2isqu, z2r, z2i, four, zero, inf, sixtyfour;
-    double tempd;
-
-    // Set initial values
-    mpf_init_set_d(zr, 0.0);
-    mpf_init_set_d(zi, 0.0);
-    mpf_init_set_d(zrsqu, 0.0);
-    mpf_init_set_d(zisqu, 0.0);
-    mpf_init_set_d(four, 4.0);
-    mpf_init_set_d(zero, 0.0);
-    mpf_init_set_d(inf, 99999999999999999.9);
+// with distance estimation an escaped orbit is followed on until |z| is this large, where the
+// estimate becomes tight. the escape itself is still counted at radius 2
+const double distanceBailout = 1e10;
+const int maxDistanceSteps = 64;
+
+// dz/dc -> 2 z dz/dc + 1, for the z before the step
+void stepDerivative(Derivative& derivative, double zr, double zi) {
+    double unit = derivative.exponent == 0 ? 1 : std::ldexp(1.0, -derivative.exponent);
+    double r = 2 * (zr * derivative.r - zi * derivative.i) + unit;
+    double i = 2 * (zr * derivative.i + zi * derivative.r);
+    derivative.r = r;
+    derivative.i = i;
+    if (std::abs(r) + std::abs(i) > 0x1p512) {
+        derivative.r = std::ldexp(r, -512);
+        derivative.i = std::ldexp(i, -512);
+        derivative.exponent += 512;
+    }
+}
+
+// natural log of a lower bound on the distance from c to the set, for an orbit that has just
+// escaped at z with the given dz/dc. past the bailout the koebe 1/4 theorem bounds it from
+// below by |z| ln|z| / (2 |dz/dc|). once escaped, doubles are plenty to get there
+double escapedLogDistance(double zr, double zi, double cr, double ci, Derivative derivative) {
+    for (int step = 0; step < maxDistanceSteps && zr * zr + zi * zi < distanceBailout * distanceBailout; step++) {
+        stepDerivative(derivative, zr, zi);
+        double r = zr * zr - zi * zi + cr;
+        zi = 2 * zr * zi + ci;
+        zr = r;
+    }
+    double magnitude = std::hypot(zr, zi);
+    return std::log(magnitude * std::log(magnitude) / 2) - std::log(std::hypot(derivative.r, derivative.i))
+         - derivative.exponent * std::log(2.0);
+}
+
+// bits of mantissa needed to resolve pixels at this zoom, rounded up to whole limbs
+unsigned long precisionForZoom(mpf_srcptr zoom) {
+    long exponent;
+    mpf_get_d_2exp(&exponent, zoom);
+    // past what a double holds the exponent alone decides, as a double the zoom would be 0
+    bool tiny = mpf_sgn(zoom) == 0 || exponent < std::numeric_limits<double>::min_exponent;
+    long bitsl = tiny ? -exponent : -std::log2(std::abs(mpf_get_d(zoom)));
+    bitsl = (bitsl >= 0) * bitsl;
+    bitsl = bitsl/32 * 32 + 64;
+    return bitsl;
+}
+
+// with an orbit, iteration continues from the state in it (if any) and the state is updated
+// to where an unescaped orbit stopped, or cleared if it escaped. with logDistance, dz/dc is
+// tracked too and an escape stores escapedLogDistance there
+MandelSample computeMandelPosition(mpf_srcptr cr, mpf_srcptr ci, long long maxIter, unsigned long precision,
+                                   std::unique_ptr<OrbitState>* orbit, double* logDistance) {
+    mpf_t zr, zi, zrsqu, zisqu, temp;
+
+    // Set initial values, with explicit precision since the default precision is shared by every thread
+    mpf_init2(zr, precision);
+    mpf_init2(zi, precision);
+    mpf_init2(zrsqu, precision);
+    mpf_init2(zisqu, precision);
+    mpf_init2(temp, precision);
     
     long long iter = 0; 
-    HSVd result;
+    Derivative derivative;
+    if (orbit && *orbit) {
+        mpf_set(zr, (*orbit)->zr.get_mpf_t());
+        mpf_set(zi, (*orbit)->zi.get_mpf_t());
+        iter = (*orbit)->iter;
+        derivative = (*orbit)->derivative;
+    }
+    MandelSample result = {maxIter, 0};
     
     while (iter < maxIter) {
+        if (logDistance) stepDerivative(derivative, mpf_get_d(zr), mpf_get_d(zi));
         mandelIterate(zr, zi, cr, ci, zrsqu, zisqu, temp);
         mpf_add(temp, zrsqu, zisqu);
-        if (mpf_cmp(temp, four) > 0) {
-            if (mpf_cmp(zr, zero) != 0) mpf_div(temp, zi, zr);
-            else mpf_set(temp, inf);
-            tempd = mpf_get_d(temp);
-            result = {std::atan(tempd), 0.5*std::exp(-gammaval*iter), 1-std::exp(-gammaval*iter)};
+        if (mpf_cmp_ui(temp, 4) > 0) {
+            result = {iter, (float)std::atan(mpf_get_d(zi) / mpf_get_d(zr))};
+            if (logDistance) {
+                *logDistance = escapedLogDistance(mpf_get_d(zr), mpf_get_d(zi), mpf_get_d(cr), mpf_get_d(ci), derivative);
+            }
+            break;
         }
         iter++;
     }
-    result = {0, 0, 0};
 
-    mpf_clear(sixtyfour);
-    mpf_clear(four);
-    mpf_clear(inf);
-    mpf_clear(zero);
+    if (orbit) {
+        if (result.iter < maxIter) {
+            orbit->reset();
+        } else if (*orbit) {
+            mpf_set((*orbit)->zr.get_mpf_t(), zr);
+            mpf_set((*orbit)->zi.get_mpf_t(), zi);
+            (*orbit)->iter = iter;
+            (*orbit)->derivative = derivative;
+        } else {
+            *orbit = std::make_unique<OrbitState>(OrbitState{mpf_class(zr, precision), mpf_class(zi, precision), iter,
+                                                             0, 0, 0, 0, derivative});
+        }
+    }
+
+    mpf_clear(temp);
     mpf_clear(zisqu);
     mpf_clear(zrsqu);
     mpf_clear(zi);
@@ -91,6 +161,78 @@ HSVd computeMandelPosition(mpf_t cr, mpf_t ci, mpf_t zoom, long long maxIter, do
     return result;
 }
 
+// the same iteration as computeMandelPosition for the point reference + (dcr, dci), in doubles:
+// z_n = Z_m + d_m with d_{m+1} = 2 Z_m d_m + d_m^2 + dc. whenever |z| drops below |d|, or the
+// reference runs out, the delta is rebased onto the start of the reference (Z_0 = 0, d = z),
+// which keeps it small and makes a short or escaped reference good for every pixel. while the
+// reference is still being computed, catching up with it waits for the next entries instead.
+// dz/dc is the same for z = Z + d however it is split, so rebasing leaves it alone
+MandelSample perturbMandelPosition(const ReferenceOrbit& reference, double dcr, double dci, long long maxIter,
+                                   std::unique_ptr<OrbitState>* orbit, double* logDistance) {
+    size_t available = reference.available();
+    double dr = 0, di = 0;
+    size_t m = 0;
+    long long iter = 0;
+    Derivative derivative;
+    if (orbit && *orbit) {
+        dr = (*orbit)->deltaR;
+        di = (*orbit)->deltaI;
+        m = (*orbit)->referenceIndex;
+        iter = (*orbit)->iter;
+        derivative = (*orbit)->derivative;
+    }
+    MandelSample result = {maxIter, 0};
+
+    while (iter < maxIter) {
+        if (m + 1 >= available) available = reference.waitFor(m + 1);
+        ReferenceOrbit::Entry Z = reference[m];
+        double zr = Z.zr + dr;
+        double zi = Z.zi + di;
+        double magnitude = zr * zr + zi * zi;
+        if (magnitude > 4) {
+            // the colouring takes the angle of the following z
+            double cr = mpf_get_d(reference.cr.get_mpf_t()) + dcr;
+            double ci = mpf_get_d(reference.ci.get_mpf_t()) + dci;
+            result = {iter, (float)std::atan((2 * zr * zi + ci) / (zr * zr - zi * zi + cr))};
+            if (logDistance) *logDistance = escapedLogDistance(zr, zi, cr, ci, derivative);
+            break;
+        }
+        if (m + 1 >= available || magnitude < dr * dr + di * di) {
+            dr = zr;
+            di = zi;
+            m = 0;
+            Z = reference[0];
+        }
+        if (logDistance) stepDerivative(derivative, zr, zi);
+        double newDr = 2 * (Z.zr * dr - Z.zi * di) + dr * dr - di * di + dcr;
+        double newDi = 2 * (Z.zr * di + Z.zi * dr) + 2 * dr * di + dci;
+        dr = newDr;
+        di = newDi;
+        m++;
+        iter++;
+    }
+
+    if (orbit) {
+        if (result.iter < maxIter) {
+            orbit->reset();
+        } else {
+            if (!*orbit) *orbit = std::make_unique<OrbitState>(OrbitState{mpf_class(0, 64), mpf_class(0, 64), 0, 0, 0, 0, 0, {}});
+            (*orbit)->iter = iter;
+            (*orbit)->referenceID = reference.id;
+            (*orbit)->referenceIndex = m;
+            (*orbit)->deltaR = dr;
+            (*orbit)->deltaI = di;
+            (*orbit)->derivative = derivative;
+        }
+    }
+    return result;
+}
+
+bool usePerturbation(const ViewSnapshot& view) {
+    double zoomd = view.zoom.get_d();
+    return view.perturbation && zoomd < perturbationZoom && zoomd > perturbationMinZoom;
+}
+
 colour8 HSVtoRGB(float h, float s, float v) {
     // Ensure h is within the range [0, 360)
     h = fmod(h * 360 / 3.14159265, 360.0f);
@@ -131,173 +273,416 @@ colour8 computeColour(HSVd hsv) {
     };
 }
 
-void colourMandelScreenRegion(std::vector<colour8>& data, 
-                            int boleftx, int bolefty, int toprightx, int toprighty, 
-                            mpf_t zoom, int scrWidth, int scrHeight, double gammaval, 
-                            bool accurateColouring, long long maxIter, ThreadPool& pool, 
-                            mpf_t viewMidX, mpf_t viewMidY, long long unsigned int currentMandelFrameID, int depth=0,
-                            bool bottomCheck = true, bool leftCheck = true, bool topCheck = true, bool rightCheck = true) 
-    {
-    if (currentMandelFrameID < globalMandelFrameID) return;
-    
-    std::vector<colour8> results;
-    
-    double zoomd = mpf_get_d(zoom);
-    long bitsl = -std::log2(zoomd);
-    bitsl = (bitsl >= 0) * bitsl;
-    bitsl = bitsl/32 * 32 + 64;
-    mpf_set_default_prec(bitsl);
+colour8 sampleColour(MandelSample sample, long long maxIter, double gammaval) {
+    if (sample.iter >= maxIter) return computeColour({0, 0, 0});
+    return computeColour({sample.angle, 0.5*std::exp(-gammaval*sample.iter), 1-std::exp(-gammaval*sample.iter)});
+}
 
-    mpf_t temp, cr, ci;
-    mpf_init(cr);
-    mpf_init(ci);
-    mpf_init(temp);
+// complex coordinate of pixel (x, y), y grows upwards like the texture. fractional
+// positions are points inside the pixel, used for supersampling
+void pixelPosition(const ViewSnapshot& view, double x, double y, mpf_t cr, mpf_t ci, mpf_t temp) {
+    mpf_set_d(temp, (x - view.sizex/2.0) / view.sizex);
+    mpf_mul(temp, temp, view.zoom.get_mpf_t());
+    mpf_add(cr, view.offsetx.get_mpf_t(), temp);
+    mpf_set_d(temp, (y - view.sizey/2.0) / view.sizex);
+    mpf_mul(temp, temp, view.zoom.get_mpf_t());
+    mpf_add(ci, view.offsety.get_mpf_t(), temp);
+}
 
-    int midx = (boleftx + toprightx) / 2;
-    int midy = (bolefty + toprighty) / 2;
-    
-    mpf_set_d(temp, (midx - scrWidth/2.0) / scrWidth);
-    mpf_mul(temp, temp, zoom);
-    mpf_add(cr, viewMidX, temp);
-    mpf_set_d(temp, (midy - scrHeight/2.0) / scrWidth);
-    mpf_mul(temp, temp, zoom);
-    mpf_add(ci, viewMidY, temp);
-    HSVd colour = computeMandelPosition(cr, ci, zoom, maxIter, gammaval, temp, accurateColouring);
-    
-    for (int i = bolefty; i < toprighty; i++) {
-        for (int j = boleftx; j < toprightx; j++) {
-            int index = i * scrWidth + j;
-            if (index < data.size() && index >= 0) {  // Bounds check
-                if (currentMandelFrameID < globalMandelFrameID) return;
-                data[index] = computeColour(colour);
-            }
+// natural log of the width of a pixel, from the mpf zoom since deep zooms are below doubles
+double logPixelSize(const ViewSnapshot& view) {
+    long exponent;
+    double mantissa = mpf_get_d_2exp(&exponent, view.zoom.get_mpf_t());
+    return std::log(mantissa) + exponent * std::log(2.0) - std::log(view.sizex);
+}
+
+bool isCancelled(const MandelJob& job) {
+    return job.frameID < globalMandelFrameID;
+}
+
+// minus the ring of tiles around the view's focus that [x0, x1) x [y0, y1) starts in, so work
+// nearer the focus is picked first. 0 for every rect without a focus
+int focusPriority(const ViewSnapshot& view, int x0, int y0, int x1, int y1) {
+    if (!view.focused) return 0;
+    double dx = std::max({x0 - view.focusX, view.focusX - x1, 0.0});
+    double dy = std::max({y0 - view.focusY, view.focusY - y1, 0.0});
+    return -(int)(std::max(dx, dy) / Frame::tileSize);
+}
+
+// sample of pixel (x, y) for the job's maxIter. when the job resumes an identical view rendered
+// with a different maxIter, escapes below both limits are taken over as they are and unescaped
+// orbits continue where they stopped, otherwise the pixel is iterated from the start. an
+// orbit that doesn't escape is kept in the frame so the next maxIter increase can continue it
+MandelSample evaluatePixel(MandelJob& job, int x, int y, mpf_t cr, mpf_t ci, mpf_t temp, long long& iterated) {
+    const ViewSnapshot& view = job.view;
+    size_t index = (size_t)y * job.frame->width + x;
+    std::unique_ptr<OrbitState> orbit;
+    if (job.resumeFrame) {
+        MandelSample known = job.resumeFrame->samples[index];
+        // a lower limit only cuts off escapes, nothing to iterate
+        if (view.maxIter <= job.resumeMaxIter) {
+            return known.iter < view.maxIter ? known : MandelSample{view.maxIter, 0};
+        }
+        // filled samples have no distance, they are only good as guesses for the old limit
+        bool interpolated = view.distanceEstimation && known.distance == 0;
+        if (known.iter < job.resumeMaxIter && !interpolated) return known;
+        if (const OrbitState* saved = job.resumeFrame->orbits[index].get()) {
+            orbit = std::make_unique<OrbitState>(*saved);
         }
     }
-    
-    int counts = 0;
-    int countBottom = 0;
-    int countLeft = 0;
-    int countTop = 0;
-    int countRight = 0;
-    
-    if ((colour.v == 0 || accurateColouring) && toprightx-boleftx > 4) {
-        int stepsx = std::pow(toprightx-boleftx, 0.667);
-        int stepsy = std::pow(toprighty-bolefty, 0.667);
-
-        if (stepsx == 0) stepsx = 1;
-        if (stepsy == 0) stepsy = 1;
-
-        struct coord {
-            double x;
-            double y;
-            char bltr;
-        };
-        std::vector<coord> positions;
-        //bottom
-        if (bottomCheck == true) {
-            for (int i = 0; i < stepsx; i++) {
-                double scrxpos = std::lerp(boleftx, toprightx, (float)i/stepsx);
-                positions.push_back({(scrxpos - scrWidth/2.0) / scrWidth, (bolefty - scrHeight/2.0) / scrWidth, 0});
+    MandelSample sample;
+    double logDistance = 0;
+    double* distance = view.distanceEstimation ? &logDistance : nullptr;
+    if (job.reference) {
+        // only a delta to this very reference orbit (or an extension of it) can be continued
+        if (orbit && orbit->referenceID != job.reference->id) orbit.reset();
+        double dcr = job.referenceOffsetX + (x - view.sizex / 2.0) * job.pixelSize;
+        double dci = job.referenceOffsetY + (y - view.sizey / 2.0) * job.pixelSize;
+        sample = perturbMandelPosition(*job.reference, dcr, dci, view.maxIter, &orbit, distance);
+    } else {
+        if (orbit && orbit->referenceID != 0) orbit.reset();
+        pixelPosition(view, x, y, cr, ci, temp);
+        sample = computeMandelPosition(cr, ci, view.maxIter, view.precision, &orbit, distance);
+    }
+    if (distance && sample.iter < view.maxIter) {
+        sample.distance = (float)std::min(std::exp(logDistance - logPixelSize(view)), 1e30);
+    }
+    job.frame->orbits[index] = std::move(orbit);
+    iterated++;
+    return sample;
+}
+
+void storeSample(MandelJob& job, int x, int y, MandelSample sample) {
+    Frame& frame = *job.frame;
+    int index = y * frame.width + x;
+    frame.samples[index] = sample;
+    frame.pixels[index] = sampleColour(sample, job.view.maxIter, job.view.gammaval);
+}
+
+// the mandelbrot set is symmetric about the real axis: with the offsets on the pixel lattice,
+// pixel rows y and axis - y are exact conjugates. false if the view's rows don't pair up
+bool mirrorAxis(const ViewSnapshot& view, long& axis) {
+    // ci(y) = -ci(axis - y) for axis = sizey - 2 offsety / pixel size
+    mpf_class rows(2 * view.offsety * view.sizex / view.zoom, view.precision);
+    double rowsd = rows.get_d();
+    if (std::abs(rowsd) > 4.0 * view.sizey) return false;
+    axis = view.sizey - std::lround(rowsd);
+    return std::abs(rowsd - std::lround(rowsd)) < 1e-6;
+}
+
+// mark [x0, x1) x [y0, y1) final, after reflecting it into the rows mirroring it that were
+// left out of the computation. a conjugate escapes at the same iteration with the angle negated
+void finishRect(MandelJob& job, int x0, int y0, int x1, int y1) {
+    Frame& frame = *job.frame;
+    for (const ScreenRect& band : job.mirrored) {
+        int tx0 = std::max(x0, band.x0), tx1 = std::min(x1, band.x1);
+        int ty0 = std::max<long>(band.y0, job.mirrorAxis - y1 + 1);
+        int ty1 = std::min<long>(band.y1, job.mirrorAxis - y0 + 1);
+        if (tx0 >= tx1 || ty0 >= ty1) continue;
+        for (int y = ty0; y < ty1; y++) {
+            size_t sourceRow = (size_t)(job.mirrorAxis - y) * frame.width;
+            size_t row = (size_t)y * frame.width;
+            for (int x = tx0; x < tx1; x++) {
+                MandelSample sample = frame.samples[sourceRow + x];
+                sample.angle = -sample.angle;
+                storeSample(job, x, y, sample);
+                // a full precision orbit mirrors too, a delta to a reference orbit doesn't
+                const OrbitState* orbit = frame.orbits[sourceRow + x].get();
+                if (orbit && orbit->referenceID == 0) {
+                    auto conjugate = std::make_unique<OrbitState>(*orbit);
+                    conjugate->zi = -conjugate->zi;
+                    conjugate->derivative.i = -conjugate->derivative.i;
+                    frame.orbits[row + x] = std::move(conjugate);
+                } else {
+                    frame.orbits[row + x].reset();
+                }
             }
         }
-        //left
-        if (leftCheck == true) {
-            for (int i = 0; i < stepsy; i++) {
-                double scrypos = std::lerp(bolefty, toprighty, (float)i/stepsy);
-                positions.push_back({(boleftx - scrWidth/2.0) / scrWidth, (scrypos - scrHeight/2.0) / scrWidth, 1});
+        frame.markFinal(tx0, ty0, tx1, ty1);
+    }
+    frame.markFinal(x0, y0, x1, y1);
+}
+
+// iterate every pixel in [x0, x1) x [y0, y1) and mark them final
+void computePixelSpan(MandelJob& job, int x0, int y0, int x1, int y1) {
+    const ViewSnapshot& view = job.view;
+    mpf_t cr, ci, temp;
+    mpf_init2(cr, view.precision);
+    mpf_init2(ci, view.precision);
+    mpf_init2(temp, view.precision);
+    bool cancelled = false;
+    long long iterated = 0;
+    for (int y = y0; y < y1 && !cancelled; y++) {
+        for (int x = x0; x < x1; x++) {
+            if (isCancelled(job)) {
+                cancelled = true;
+                break;
             }
+            storeSample(job, x, y, evaluatePixel(job, x, y, cr, ci, temp, iterated));
         }
-        //top
-        if (topCheck == true) {
-            for (int i = 0; i < stepsx; i++) {
-                double scrxpos = std::lerp(boleftx, toprightx, (float)i/stepsx);
-                positions.push_back({(scrxpos - scrWidth/2.0) / scrWidth, (toprighty - scrHeight/2.0) / scrWidth, 2});
-            }
+    }
+    mpf_clear(cr);
+    mpf_clear(ci);
+    mpf_clear(temp);
+    job.pixelsIterated += iterated;
+    if (cancelled) return;
+    finishRect(job, x0, y0, x1, y1);
+}
+
+// interior of the rectangle with corners (x0, y0) and (x1, y1) inclusive, escape time and
+// angle interpolated bilinearly between the corners
+void interpolateInterior(MandelJob& job, int x0, int y0, int x1, int y1) {
+    Frame& frame = *job.frame;
+    MandelSample a = frame.samples[y0 * frame.width + x0], b = frame.samples[y0 * frame.width + x1];
+    MandelSample c = frame.samples[y1 * frame.width + x0], d = frame.samples[y1 * frame.width + x1];
+    for (int y = y0 + 1; y < y1; y++) {
+        double v = double(y - y0) / (y1 - y0);
+        for (int x = x0 + 1; x < x1; x++) {
+            double u = double(x - x0) / (x1 - x0);
+            auto blend = [&](double p, double q, double r, double s) {
+                return (1 - v) * ((1 - u) * p + u * q) + v * ((1 - u) * r + u * s);
+            };
+            storeSample(job, x, y, {std::llround(blend(a.iter, b.iter, c.iter, d.iter)),
+                                    (float)blend(a.angle, b.angle, c.angle, d.angle)});
         }
-        //right
-        if (rightCheck == true) {
-            for (int i = 0; i < stepsy; i++) {
-                double scrypos = std::lerp(bolefty, toprighty, (float)i/stepsy);
-                positions.push_back({(toprightx - scrWidth/2.0) / scrWidth, (scrypos - scrHeight/2.0) / scrWidth, 3});
+    }
+    finishRect(job, x0 + 1, y0 + 1, x1, y1);
+}
+
+// a rect predicted to take this many iterations is worth a task of its own however small
+const double taskCost = 1 << 18;
+
+// iterations expected to finish the rectangle with corners (x0, y0) and (x1, y1) inclusive, whose
+// border is done: from the job's cost map if it has one, otherwise the border's mean escape time
+// over the interior
+double predictedCost(const MandelJob& job, int x0, int y0, int x1, int y1) {
+    if (job.cost) return job.cost->cost(x0 + 1, y0 + 1, x1, y1);
+    const Frame& frame = *job.frame;
+    double border = 0;
+    for (int x = x0; x <= x1; x++) {
+        border += std::min(frame.samples[y0 * frame.width + x].iter, job.view.maxIter);
+        border += std::min(frame.samples[y1 * frame.width + x].iter, job.view.maxIter);
+    }
+    for (int y = y0 + 1; y < y1; y++) {
+        border += std::min(frame.samples[y * frame.width + x0].iter, job.view.maxIter);
+        border += std::min(frame.samples[y * frame.width + x1].iter, job.view.maxIter);
+    }
+    return border / (2 * (x1 - x0 + y1 - y0)) * (x1 - x0 - 1) * (y1 - y0 - 1);
+}
+
+// mariani-silver's tasks run ring by ring out from the focus, if there is one, and longest
+// expected first within a ring. all of them after the grid lines
+int regionPriority(const MandelJob& job, int x0, int y0, int x1, int y1, double cost) {
+    return (int)std::log2(1 + cost) - 64 + 64 * focusPriority(job.view, x0, y0, x1 + 1, y1 + 1);
+}
+
+// Mariani-Silver: the rectangle with corners (x0, y0) and (x1, y1) inclusive already has its
+// whole border evaluated. if every border pixel has the same iteration count the interior is
+// filled without being iterated, otherwise the rectangle is split in two along a new line that
+// becomes the shared border of both halves. every pixel is evaluated at most once and nothing
+// depends on scheduling order, so the image is the same for any number of threads
+void colourMandelScreenRegion(std::shared_ptr<MandelJob> job, int x0, int y0, int x1, int y1) {
+    if (isCancelled(*job)) return;
+    if (x1 - x0 < 2 || y1 - y0 < 2) return;
+
+    Frame& frame = *job->frame;
+    const ViewSnapshot& view = job->view;
+    MandelSample first = frame.samples[y0 * frame.width + x0];
+    // without accurateColouring only the set itself is guessed, escaped bands are always iterated
+    bool uniform = first.iter >= view.maxIter || view.accurateColouring;
+    for (int x = x0; x <= x1 && uniform; x++) {
+        uniform = frame.samples[y0 * frame.width + x].iter == first.iter
+               && frame.samples[y1 * frame.width + x].iter == first.iter;
+    }
+    for (int y = y0 + 1; y < y1 && uniform; y++) {
+        uniform = frame.samples[y * frame.width + x0].iter == first.iter
+               && frame.samples[y * frame.width + x1].iter == first.iter;
+    }
+    // a uniform border can hide a filament, certified renders also need the inside proven
+    if (uniform && view.certifiedFill) uniform = certifyRect(view, x0, y0, x1, y1) == first.iter;
+
+    if (uniform) {
+        // a distance only holds for the pixel it was estimated at
+        MandelSample fill = {first.iter, first.angle};
+        for (int y = y0 + 1; y < y1; y++) {
+            for (int x = x0 + 1; x < x1; x++) {
+                storeSample(*job, x, y, fill);
             }
         }
-        
-        std::shuffle(positions.begin(), positions.end(), g);
-        
-        for (int i = 0; i < positions.size(); i++) {
-            mpf_set_d(temp, positions[i].x);
-            mpf_mul(temp, temp, zoom);
-            mpf_add(cr, viewMidX, temp);
-            mpf_set_d(temp, positions[i].y);
-            mpf_mul(temp, temp, zoom);
-            mpf_add(ci, viewMidY, temp);
-            gmp_printf("r: %.*Ff i: %.*Ff \n", bitsl, cr, bitsl, ci);
-            auto result = computeMandelPosition(cr, ci, zoom, maxIter, gammaval, temp, accurateColouring);
-            if (result.v != colour.v) {
-                counts++;
-                break;
+        finishRect(*job, x0 + 1, y0 + 1, x1, y1);
+        return;
+    }
+
+    // the whole rectangle is within its diagonal of each corner, a corner at least that far
+    // from the set proves all of it outside, and it is interpolated rather than iterated.
+    // interpolated counts aren't proven though, certified renders subdivide these rects instead
+    if (view.distanceEstimation && !view.certifiedFill) {
+        float diagonal = std::hypot(x1 - x0, y1 - y0);
+        for (int y : {y0, y1}) {
+            for (int x : {x0, x1}) {
+                if (frame.samples[y * frame.width + x].distance >= diagonal) {
+                    interpolateInterior(*job, x0, y0, x1, y1);
+                    return;
+                }
             }
         }
-        
-    } else {
-        counts = 1;
     }
-    
-    mpf_clear(cr);
-    mpf_clear(ci);
-    mpf_clear(temp);
-    if (counts == 0) {
+
+    if ((x1 - x0 - 1) * (y1 - y0 - 1) <= 16) {
+        computePixelSpan(*job, x0 + 1, y0 + 1, x1, y1);
         return;
     }
-    //std::cout << "----------" << std::endl;    
-    // Calculate midpoints using both boundaries
-    depth++;
-    if ((toprightx - boleftx < 2) && (toprighty - bolefty < 2)) return;
-
-    if (toprightx-boleftx >= 0.5*log(scrWidth * scrHeight)) {
-        int priority = -depth;
-        // bottom left
-        pool.addTask([=, &data, &pool]() {
-            colourMandelScreenRegion(data, boleftx, bolefty, midx, midy, zoom, scrWidth, scrHeight, 
-                                    gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        }, priority);
-        //bottom right
-        pool.addTask([=, &data, &pool]() {
-            colourMandelScreenRegion(data, midx, bolefty, toprightx, midy, zoom, scrWidth, scrHeight, 
-                                    gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        }, priority);
-        //top left
-        pool.addTask([=, &data, &pool]() {
-            colourMandelScreenRegion(data, boleftx, midy, midx, toprighty, zoom, scrWidth, scrHeight, 
-                                    gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        }, priority);
-        //top right
-        pool.addTask([=, &data, &pool]() {
-            colourMandelScreenRegion(data, midx, midy, toprightx, toprighty, zoom, scrWidth, scrHeight, 
-                                    gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        }, priority);
+
+    // split across the longer side
+    int childx0 = x0, childy0 = y0, childx1 = x1, childy1 = y1;
+    if (x1 - x0 >= y1 - y0) {
+        int midx = (x0 + x1) / 2;
+        computePixelSpan(*job, midx, y0 + 1, midx + 1, y1);
+        childx1 = midx;
+        childx0 = midx;
     } else {
-        //bottom left
-        colourMandelScreenRegion(data, boleftx, bolefty, midx, midy, zoom, scrWidth, scrHeight, 
-                                gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        //bottom right
-        colourMandelScreenRegion(data, midx, bolefty, toprightx, midy, zoom, scrWidth, scrHeight, 
-                                gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        //top left
-        colourMandelScreenRegion(data, boleftx, midy, midx, toprighty, zoom, scrWidth, scrHeight, 
-                                gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
-        //top right
-        colourMandelScreenRegion(data, midx, midy, toprightx, toprighty, zoom, scrWidth, scrHeight, 
-                                gammaval, accurateColouring, maxIter, pool, viewMidX, viewMidY, currentMandelFrameID, depth, true, true, true, true);
+        int midy = (y0 + y1) / 2;
+        computePixelSpan(*job, x0 + 1, midy, x1, midy + 1);
+        childy1 = midy;
+        childy0 = midy;
     }
+    if (isCancelled(*job)) return;
+
+    // halves of a big rectangle and expensive ones go back to the pool, ordered by what they
+    // are expected to cost
+    bool big = (x1 - x0) * (y1 - y0) >= 64 * 64;
+    for (ScreenRect child : {ScreenRect{x0, y0, childx1, childy1}, ScreenRect{childx0, childy0, x1, y1}}) {
+        int area = (child.x1 - child.x0) * (child.y1 - child.y0);
+        double cost = big || area >= 16 * 16 ? predictedCost(*job, child.x0, child.y0, child.x1, child.y1) : 0;
+        if (big || cost >= taskCost) {
+            job->pool.addTask([=]() {
+                colourMandelScreenRegion(job, child.x0, child.y0, child.x1, child.y1);
+            }, regionPriority(*job, child.x0, child.y0, child.x1, child.y1, cost));
+        } else {
+            colourMandelScreenRegion(job, child.x0, child.y0, child.x1, child.y1);
+        }
+    }
+}
+
+// rect minus cut, in up to four pieces
+void subtractRect(const ScreenRect& rect, const ScreenRect& cut, std::vector<ScreenRect>& pieces) {
+    if (cut.x0 >= rect.x1 || cut.x1 <= rect.x0 || cut.y0 >= rect.y1 || cut.y1 <= rect.y0) {
+        pieces.push_back(rect);
+        return;
+    }
+    if (rect.y0 < cut.y0) pieces.push_back({rect.x0, rect.y0, rect.x1, cut.y0});
+    if (cut.y1 < rect.y1) pieces.push_back({rect.x0, cut.y1, rect.x1, rect.y1});
+    int y0 = std::max(rect.y0, cut.y0), y1 = std::min(rect.y1, cut.y1);
+    if (rect.x0 < cut.x0) pieces.push_back({rect.x0, y0, cut.x0, y1});
+    if (cut.x1 < rect.x1) pieces.push_back({cut.x1, y0, rect.x1, y1});
+}
+
+// the pixels below the real axis whose mirror image is computed too are left to finishRect,
+// the rest of the regions is returned to be computed
+std::vector<ScreenRect> splitMirrored(MandelJob& job, const std::vector<ScreenRect>& regions) {
+    long axis;
+    if (!mirrorAxis(job.view, axis)) return regions;
+    job.mirrorAxis = axis;
+    // rows strictly below the axis, 2y < axis
+    long belowAxis = (axis + 1) / 2;
+    for (const ScreenRect& target : regions) {
+        for (const ScreenRect& source : regions) {
+            ScreenRect band{std::max(target.x0, source.x0),
+                            (int)std::max<long>(target.y0, axis - source.y1 + 1),
+                            std::min(target.x1, source.x1),
+                            (int)std::min<long>({(long)target.y1, axis - source.y0 + 1, belowAxis})};
+            if (band.x0 < band.x1 && band.y0 < band.y1) job.mirrored.push_back(band);
+        }
+    }
+    std::vector<ScreenRect> computed = regions;
+    for (const ScreenRect& band : job.mirrored) {
+        std::vector<ScreenRect> pieces;
+        for (const ScreenRect& rect : computed) subtractRect(rect, band, pieces);
+        computed = std::move(pieces);
+    }
+    return computed;
 }
 
-bool computeMandel(int sizex, int sizey, long long maxIter, std::vector<colour8>& data, mpf_t offsetx, mpf_t offsety, mpf_t zoom, double gammaval, bool accurateColouring, ThreadPool& pool, long long unsigned int currentMandelFrameID) {
-    globalMandelFrameID = currentMandelFrameID;
-    colourMandelScreenRegion(data, 0, 0, sizex, sizey, zoom, sizex, sizey, gammaval, accurateColouring, maxIter, pool, offsetx, offsety, globalMandelFrameID, 0);
+// the lines of a coarse grid are evaluated up front in parallel, then every cell of the grid
+// runs Mariani-Silver with its four sides as the initial border. each region gets its own grid,
+// regions must not overlap. rows mirroring others across the real axis are reflected instead
+bool computeMandelRegions(std::shared_ptr<MandelJob> job, const std::vector<ScreenRect>& requested) {
+    const int gridSpacing = 128;
+    std::vector<ScreenRect> regions = splitMirrored(*job, requested);
+    std::vector<std::future<void>> lines;
+    std::vector<std::pair<std::vector<int>, std::vector<int>>> grids;
+    for (const ScreenRect& region : regions) {
+        int width = region.x1 - region.x0;
+        int height = region.y1 - region.y0;
+        if (width < 3 || height < 3) {
+            // thin strips have no interior to guess
+            lines.push_back(job->pool.addTask([=]() { computePixelSpan(*job, region.x0, region.y0, region.x1, region.y1); }, 1));
+            continue;
+        }
+
+        std::vector<int> columns, rows;
+        for (int x = region.x0; x < region.x1 - 1; x += gridSpacing) columns.push_back(x);
+        columns.push_back(region.x1 - 1);
+        for (int y = region.y0; y < region.y1 - 1; y += gridSpacing) rows.push_back(y);
+        rows.push_back(region.y1 - 1);
+
+        // rows span the full width, columns stop short of the rows so no pixel is done twice
+        for (int y : rows) {
+            for (int x = region.x0; x < region.x1; x += gridSpacing) {
+                int x1 = std::min(x + gridSpacing, region.x1);
+                lines.push_back(job->pool.addTask([=]() { computePixelSpan(*job, x, y, x1, y + 1); }, 1));
+            }
+        }
+        for (int x : columns) {
+            for (size_t j = 0; j + 1 < rows.size(); j++) {
+                int y0 = rows[j] + 1, y1 = rows[j + 1];
+                lines.push_back(job->pool.addTask([=]() { computePixelSpan(*job, x, y0, x + 1, y1); }, 1));
+            }
+        }
+        grids.emplace_back(std::move(columns), std::move(rows));
+    }
+    for (auto& line : lines) line.wait();
+    if (isCancelled(*job)) return false;
+
+    for (const auto& [columns, rows] : grids) {
+        for (size_t j = 0; j + 1 < rows.size(); j++) {
+            for (size_t i = 0; i + 1 < columns.size(); i++) {
+                int x0 = columns[i], x1 = columns[i + 1], y0 = rows[j], y1 = rows[j + 1];
+                job->pool.addTask([=]() { colourMandelScreenRegion(job, x0, y0, x1, y1); },
+                                  regionPriority(*job, x0, y0, x1, y1, predictedCost(*job, x0, y0, x1, y1)));
+            }
+        }
+    }
     return true;
 }
 
+bool computeMandel(std::shared_ptr<MandelJob> job) {
+    if (job->view.algorithm == RenderAlgorithm::BoundaryTrace) {
+        return computeMandelBoundaryTrace(job);
+    }
+    if (job->view.algorithm == RenderAlgorithm::Progressive) {
+        return computeMandelProgressive(job);
+    }
+    return computeMandelRegions(job, {{0, 0, job->view.sizex, job->view.sizey}});
+}
+
+const char* algorithmName(RenderAlgorithm algorithm) {
+    switch (algorithm) {
+        case RenderAlgorithm::MarianiSilver: return "mariani-silver";
+        case RenderAlgorithm::BoundaryTrace: return "boundary trace";
+        case RenderAlgorithm::Progressive: return "progressive";
+    }
+    return "unknown";
+}
+
+// printed once the last tile of a frame is done, for comparing the algorithms
+void reportFrameStats(const MandelJob& job) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    double iterated = 100.0 * job.pixelsIterated / ((double)job.view.sizex * job.view.sizey);
+    std::cout << "frame " << job.frameID << ": " << algorithmName(job.view.algorithm) << ", " << iterated << "% of pixels iterated, "
+              << seconds << "s" << std::endl;
+}
+
 int main(int, char**) {
     std::cout << "Executing in " << std::filesystem::current_path() << "\n";
     runGraphicsEngine();
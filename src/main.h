@@ -1,4 +1,10 @@
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include "threadPool.h"
@@ -12,12 +18,173 @@ struct colour8 {
     uint8_t a = 1;
 };
 
+// result of iterating one point: the iteration it escaped at (maxIter if it never did)
+// and atan(zi/zr) at escape, which the colouring uses as hue. with distance estimation an
+// escaped point also gets a lower bound on its distance to the set, in pixels, 0 if unknown
+struct MandelSample {
+    long long iter;
+    float angle;
+    float distance = 0;
+};
+
+// dz/dc of an orbit as (r + i i) * 2^exponent, it grows exponentially along the orbit and
+// would overflow a plain double long before deep orbits end
+struct Derivative {
+    double r = 0;
+    double i = 0;
+    long exponent = 0;
+};
+
+// everything needed to continue iterating a point that hasn't escaped yet. orbits iterated
+// by perturbation keep their delta to the reference orbit instead of z
+struct OrbitState {
+    mpf_class zr;
+    mpf_class zi;
+    long long iter;
+    uint64_t referenceID = 0; // 0 for a full precision orbit
+    long long referenceIndex = 0;
+    double deltaR = 0;
+    double deltaI = 0;
+    Derivative derivative; // only kept up to date with distance estimation
+};
+
 struct HSVd {
     double h;
     double s;
     double v;
 };
 
+enum class RenderAlgorithm {
+    MarianiSilver,  // recursive rectangle subdivision with shared borders
+    BoundaryTrace,  // follow the edges of each iteration band, flood fill the inside
+    Progressive     // interlaced coarse to fine passes with a preview after each one
+};
+
+// immutable copy of everything a frame depends on, the coordinates are deep copies
+// so the ui thread can keep changing offsetx/offsety/zoom while workers read these
+struct ViewSnapshot {
+    int sizex;
+    int sizey;
+    long long maxIter;
+    double gammaval;
+    bool accurateColouring;
+    unsigned long precision;
+    mpf_class offsetx;
+    mpf_class offsety;
+    mpf_class zoom;
+    RenderAlgorithm algorithm = RenderAlgorithm::MarianiSilver;
+    bool antiAlias = false;
+    bool perturbation = true; // iterate deep views as deltas to a reference orbit
+    bool autoMaxIter = false; // the coordinator may re-render with the maxIter the frame turns out to need
+    bool distanceEstimation = false; // track dz/dc so mariani-silver can fill rects that are provably outside
+    bool certifiedFill = false; // mariani-silver only fills rects proven uniform by interval arithmetic
+    // with a focus, tiles are scheduled in rings out from pixel (focusX, focusY), nearest first
+    bool focused = false;
+    double focusX = 0;
+    double focusY = 0;
+};
+
+// half-open pixel rectangle [x0, x1) x [y0, y1)
+struct ScreenRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// pixel (x, y) of a new frame is pixel (scale * x + dx, scale * y + dy) of an older one
+struct PixelMapping {
+    int scale;
+    int dx;
+    int dy;
+};
+
+// views further apart in scale than this have too little in common to bother
+const int maxReuseScale = 64;
+
+class Frame;
+class ReferenceOrbit;
+class CostMap;
+
+// state shared by every task of one frame, tasks hold it by shared_ptr so the
+// snapshot outlives the last task even after the frame has been superseded
+struct MandelJob {
+    MandelJob(ViewSnapshot view, std::shared_ptr<Frame> frame, ThreadPool& pool, long long unsigned int frameID)
+        : view(std::move(view))
+        , frame(std::move(frame))
+        , pool(pool)
+        , frameID(frameID)
+        , started(std::chrono::steady_clock::now()) {}
+
+    ViewSnapshot view;
+    std::shared_ptr<Frame> frame;
+    ThreadPool& pool;
+    long long unsigned int frameID;
+    std::chrono::steady_clock::time_point started;
+    std::atomic<long long> pixelsIterated{0}; // pixels actually run through the kernel
+    // the same view rendered with another maxIter, its samples and orbits are continued
+    std::shared_ptr<const Frame> resumeFrame;
+    long long resumeMaxIter = 0;
+    // set when the frame is rendered by perturbation: the reference orbit, the offset of the
+    // view's centre from it and the pixel size, as doubles
+    std::shared_ptr<const ReferenceOrbit> reference;
+    double referenceOffsetX = 0;
+    double referenceOffsetY = 0;
+    double pixelSize = 0;
+    // rows y and mirrorAxis - y are complex conjugates. the mirrored rects aren't computed,
+    // they are reflected from their counterparts as those become final
+    long mirrorAxis = 0;
+    std::vector<ScreenRect> mirrored;
+    // predicted from the last finished frame, orders mariani-silver's tasks longest first
+    std::shared_ptr<const CostMap> cost;
+};
+
+extern std::atomic<long long unsigned int> globalMandelFrameID;
+
+// views zoomed in further than this are rendered by perturbation, below perturbationMinZoom
+// the deltas would underflow doubles and the full precision kernel takes over again
+const double perturbationZoom = 1e-6;
+const double perturbationMinZoom = 1e-290;
+
+void mandelIterate(mpf_t zr, mpf_t zi, const mpf_t cr, const mpf_t ci, mpf_t zrsqu, mpf_t zisqu, mpf_t temp);
+unsigned long precisionForZoom(mpf_srcptr zoom);
+MandelSample computeMandelPosition(mpf_srcptr cr, mpf_srcptr ci, long long maxIter, unsigned long precision,
+                                   std::unique_ptr<OrbitState>* orbit = nullptr, double* logDistance = nullptr);
+colour8 sampleColour(MandelSample sample, long long maxIter, double gammaval);
+void pixelPosition(const ViewSnapshot& view, double x, double y, mpf_t cr, mpf_t ci, mpf_t temp);
+bool isCancelled(const MandelJob& job);
+int focusPriority(const ViewSnapshot& view, int x0, int y0, int x1, int y1);
+MandelSample perturbMandelPosition(const ReferenceOrbit& reference, double dcr, double dci, long long maxIter,
+                                   std::unique_ptr<OrbitState>* orbit = nullptr, double* logDistance = nullptr);
+bool usePerturbation(const ViewSnapshot& view);
+MandelSample evaluatePixel(MandelJob& job, int x, int y, mpf_t cr, mpf_t ci, mpf_t temp, long long& iterated);
+void storeSample(MandelJob& job, int x, int y, MandelSample sample);
+bool mirrorAxis(const ViewSnapshot& view, long& axis);
+void finishRect(MandelJob& job, int x0, int y0, int x1, int y1);
+bool computeMandel(std::shared_ptr<MandelJob> job);
+bool computeMandelRegions(std::shared_ptr<MandelJob> job, const std::vector<ScreenRect>& regions);
+bool computeMandelBoundaryTrace(std::shared_ptr<MandelJob> job);
+bool computeMandelProgressive(std::shared_ptr<MandelJob> job);
+bool viewProjection(const ViewSnapshot& from, const ViewSnapshot& to, double& scale, double& dx, double& dy);
+bool sameViewport(const ViewSnapshot& from, const ViewSnapshot& to);
+bool pixelMapping(const ViewSnapshot& from, const ViewSnapshot& to, PixelMapping& mapping);
+std::vector<ScreenRect> reuseFrame(MandelJob& job, const Frame& source, const PixelMapping& mapping);
+void publishReprojection(MandelJob& job, const Frame& source, const ViewSnapshot& sourceView);
+void computeAntiAlias(std::shared_ptr<MandelJob> job, std::shared_ptr<const Frame> source);
+long long ballPeriod(const mpf_class& cr, const mpf_class& ci, const mpf_class& radius, long long maxPeriod,
+                     const std::atomic<bool>* cancel = nullptr);
+bool newtonPoint(mpf_class& cr, mpf_class& ci, long long preperiod, long long period,
+                 const std::atomic<bool>* cancel = nullptr);
+mpf_class minibrotSize(const mpf_class& cr, const mpf_class& ci, long long period);
+bool findMinibrot(const ViewSnapshot& view, double x, double y, mpf_class& cr, mpf_class& ci, mpf_class& zoom,
+                  long long& period, const std::atomic<bool>* cancel = nullptr);
+bool findMisiurewicz(const ViewSnapshot& view, double x, double y, mpf_class& cr, mpf_class& ci,
+                     long long& preperiod, long long& period, const std::atomic<bool>* cancel = nullptr);
+long long suggestMaxIter(const MandelJob& job);
+long long certifyRect(const ViewSnapshot& view, int x0, int y0, int x1, int y1);
+const char* algorithmName(RenderAlgorithm algorithm);
+void writeRawImg(std::int32_t width, std::int32_t height, const std::vector<colour8>& data);
+void reportFrameStats(const MandelJob& job);
+std::string calcRawImg(int32_t width, int32_t height, const std::vector<colour8>& data);
 
-bool computeMandel(int sizex, int sizey, long long maxIter, std::vector<colour8>& data, mpf_t offsetx, mpf_t offsety, mpf_t zoom, double gammaval, bool accurateColouring, ThreadPool& pool, long long unsigned int currentMandelFrameID);
-std::string calcRawImg(int32_t width, int32_t height, const std::vector<colour8>& data);
\ No newline at end of file
+#endif
@@ -0,0 +1,215 @@
+#include <cmath>
+#include <vector>
+#include "main.h"
+
+namespace {
+
+const int maxNewtonSteps = 64;
+// a minibrot is framed at this many times its size estimate
+const int minibrotFrame = 4;
+// each attempt at a smaller minibrot looks this much closer around the cursor
+const int radiusShrink = 4;
+const int maxAttempts = 40;
+// longest preperiod + period tried for misiurewicz points
+const int misiurewiczSearch = 256;
+
+// one step of z -> z^2 + c together with its derivative dz/dc -> 2 z dz/dc + 1
+void iterateWithDerivative(mpf_t zr, mpf_t zi, mpf_t dr, mpf_t di, mpf_srcptr cr, mpf_srcptr ci, mpf_t t1, mpf_t t2) {
+    mpf_mul(t1, zr, dr);
+    mpf_mul(t2, zi, di);
+    mpf_sub(t1, t1, t2);
+    mpf_mul_2exp(t1, t1, 1);
+    mpf_add_ui(t1, t1, 1);
+    mpf_mul(t2, zr, di);
+    mpf_mul(di, zi, dr);
+    mpf_add(di, di, t2);
+    mpf_mul_2exp(di, di, 1);
+    mpf_swap(dr, t1);
+
+    mpf_mul(t1, zr, zi);
+    mpf_mul(zr, zr, zr);
+    mpf_mul(t2, zi, zi);
+    mpf_sub(zr, zr, t2);
+    mpf_add(zr, zr, cr);
+    mpf_mul_2exp(zi, t1, 1);
+    mpf_add(zi, zi, ci);
+}
+
+} // namespace
+
+// lowest n for which the disk of the given radius around c maps onto a disk around z_n that
+// contains 0, tracked as a ball z_n + r_n: r_{n+1} = r_n (2 |z_n| + r_n) + radius bounds the
+// image of the disk. the period of the most prominent minibrot in the disk, 0 if there is
+// none within maxPeriod or the whole disk escapes. with cancel, setting it gives up with 0
+long long ballPeriod(const mpf_class& cr, const mpf_class& ci, const mpf_class& radius, long long maxPeriod,
+                     const std::atomic<bool>* cancel) {
+    unsigned long precision = cr.get_prec();
+    mpf_class zr(0, precision), zi(0, precision), r(0, precision), magnitude(0, precision), temp(0, precision);
+    for (long long n = 1; n <= maxPeriod; n++) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return 0;
+        magnitude = sqrt(zr * zr + zi * zi);
+        r = r * (2 * magnitude + r) + radius;
+        temp = zr * zr - zi * zi + cr;
+        zi = 2 * zr * zi + ci;
+        zr = temp;
+        magnitude = sqrt(zr * zr + zi * zi);
+        if (cmp(magnitude, r) <= 0) return n;
+        temp = magnitude - r;
+        if (cmp(temp, 2) > 0) return 0;
+    }
+    return 0;
+}
+
+// newton's method on z_{preperiod + period}(c) - z_preperiod(c) = 0, starting from c and at
+// c's precision. a preperiod of 0 finds the nucleus of a period p component, otherwise a
+// misiurewicz point. false if it didn't converge or was cancelled
+bool newtonPoint(mpf_class& cr, mpf_class& ci, long long preperiod, long long period,
+                 const std::atomic<bool>* cancel) {
+    unsigned long precision = cr.get_prec();
+    ci.set_prec(precision);
+    mpf_t zr, zi, dr, di, qr, qi, qdr, qdi, t1, t2;
+    for (mpf_ptr value : {zr, zi, dr, di, qr, qi, qdr, qdi, t1, t2}) mpf_init2(value, precision);
+    // converged once the step is within a few bits of the precision
+    mpf_class epsilon(1, precision);
+    mpf_div_2exp(epsilon.get_mpf_t(), epsilon.get_mpf_t(), 2 * (precision - 16));
+
+    auto cancelled = [cancel]() { return cancel && cancel->load(std::memory_order_relaxed); };
+    bool converged = false;
+    for (int step = 0; step < maxNewtonSteps && !converged; step++) {
+        for (mpf_ptr value : {zr, zi, dr, di, qr, qi, qdr, qdi}) mpf_set_ui(value, 0);
+        for (long long i = 0; i < preperiod + period && !cancelled(); i++) {
+            if (i == preperiod && preperiod > 0) {
+                mpf_set(qr, zr);
+                mpf_set(qi, zi);
+                mpf_set(qdr, dr);
+                mpf_set(qdi, di);
+            }
+            iterateWithDerivative(zr, zi, dr, di, cr.get_mpf_t(), ci.get_mpf_t(), t1, t2);
+        }
+        if (cancelled()) break;
+        // g = z_{q+p} - z_q, c -= g / g'
+        mpf_sub(zr, zr, qr);
+        mpf_sub(zi, zi, qi);
+        mpf_sub(dr, dr, qdr);
+        mpf_sub(di, di, qdi);
+        mpf_class denominator(mpf_class(dr) * mpf_class(dr) + mpf_class(di) * mpf_class(di), precision);
+        if (sgn(denominator) == 0) break;
+        mpf_class stepr((mpf_class(zr) * mpf_class(dr) + mpf_class(zi) * mpf_class(di)) / denominator, precision);
+        mpf_class stepi((mpf_class(zi) * mpf_class(dr) - mpf_class(zr) * mpf_class(di)) / denominator, precision);
+        cr -= stepr;
+        ci -= stepi;
+        converged = cmp(stepr * stepr + stepi * stepi, epsilon) < 0;
+    }
+
+    for (mpf_ptr value : {zr, zi, dr, di, qr, qi, qdr, qdi, t1, t2}) mpf_clear(value);
+    return converged;
+}
+
+// estimated radius of the minibrot with nucleus c, the main cardioid being 1:
+// 1 / |b l^2| with l = prod 2 z_i and b = 1 + sum 1 / l_i over the first period - 1 steps
+mpf_class minibrotSize(const mpf_class& cr, const mpf_class& ci, long long period) {
+    unsigned long precision = cr.get_prec();
+    mpf_class zr(0, precision), zi(0, precision), lr(1, precision), li(0, precision);
+    mpf_class br(1, precision), bi(0, precision), temp(0, precision), magnitude(0, precision);
+    for (long long i = 1; i < period; i++) {
+        temp = zr * zr - zi * zi + cr;
+        zi = 2 * zr * zi + ci;
+        zr = temp;
+        temp = 2 * (zr * lr - zi * li);
+        li = 2 * (zr * li + zi * lr);
+        lr = temp;
+        magnitude = lr * lr + li * li;
+        br += lr / magnitude;
+        bi -= li / magnitude;
+    }
+    magnitude = lr * lr + li * li;
+    return mpf_class(1 / (sqrt(br * br + bi * bi) * magnitude), precision);
+}
+
+// the next minibrot down near pixel (x, y) of view: the lowest period the ball method sees
+// around the cursor, solved for its nucleus, and smaller than the view so the current one
+// isn't found again. zoom frames it, and cr, ci come at the precision that zoom needs
+bool findMinibrot(const ViewSnapshot& view, double x, double y, mpf_class& cr, mpf_class& ci, mpf_class& zoom,
+                  long long& period, const std::atomic<bool>* cancel) {
+    unsigned long precision = view.precision;
+    mpf_t positionr, positioni, temp;
+    mpf_init2(positionr, precision);
+    mpf_init2(positioni, precision);
+    mpf_init2(temp, precision);
+    pixelPosition(view, x, y, positionr, positioni, temp);
+    mpf_class startr(positionr, precision), starti(positioni, precision);
+    mpf_clear(temp);
+    mpf_clear(positioni);
+    mpf_clear(positionr);
+
+    mpf_class radius(view.zoom / 2, precision);
+    for (int attempt = 0; attempt < maxAttempts; attempt++, radius /= radiusShrink) {
+        long long p = ballPeriod(startr, starti, radius, view.maxIter, cancel);
+        if (p == 0) return false;
+        mpf_class nucleusr(startr, precision), nucleusi(starti, precision);
+        if (!newtonPoint(nucleusr, nucleusi, 0, p, cancel)) continue;
+        mpf_class size = minibrotSize(nucleusr, nucleusi, p);
+        // a minibrot much smaller than a pixel moves when solved more precisely
+        unsigned long needed = precisionForZoom(size.get_mpf_t()) + 32;
+        if (needed > precision) {
+            nucleusr.set_prec(needed);
+            if (!newtonPoint(nucleusr, nucleusi, 0, p, cancel)) continue;
+            size = minibrotSize(nucleusr, nucleusi, p);
+        }
+        mpf_class distance(hypot(nucleusr - startr, nucleusi - starti), precision);
+        if (cmp(distance, 2 * radius) > 0) continue;
+        if (cmp(size * minibrotFrame, view.zoom / radiusShrink) >= 0) continue;
+        cr = nucleusr;
+        ci = nucleusi;
+        zoom = mpf_class(size * minibrotFrame, nucleusr.get_prec());
+        period = p;
+        return true;
+    }
+    return false;
+}
+
+// the misiurewicz point nearest pixel (x, y): the preperiod and period come from where the
+// orbit of the cursor comes closest to repeating itself, then newton refines the point.
+// false if it didn't converge to a point in view
+bool findMisiurewicz(const ViewSnapshot& view, double x, double y, mpf_class& cr, mpf_class& ci,
+                     long long& preperiod, long long& period, const std::atomic<bool>* cancel) {
+    unsigned long precision = view.precision;
+    mpf_t zr, zi, startr, starti, zrsqu, zisqu, temp;
+    for (mpf_ptr value : {zr, zi, startr, starti, zrsqu, zisqu, temp}) mpf_init2(value, precision);
+    pixelPosition(view, x, y, startr, starti, temp);
+    mpf_set_ui(zr, 0);
+    mpf_set_ui(zi, 0);
+    // the orbit itself is of order 1, doubles are plenty to compare it with itself
+    std::vector<double> orbitr{0}, orbiti{0};
+    long long length = std::min<long long>(misiurewiczSearch, view.maxIter);
+    for (long long n = 1; n < length; n++) {
+        mandelIterate(zr, zi, startr, starti, zrsqu, zisqu, temp);
+        double r = mpf_get_d(zr), i = mpf_get_d(zi);
+        if (r * r + i * i > 16) break;
+        orbitr.push_back(r);
+        orbiti.push_back(i);
+    }
+    mpf_class pointr(startr, precision), pointi(starti, precision);
+    for (mpf_ptr value : {zr, zi, startr, starti, zrsqu, zisqu, temp}) mpf_clear(value);
+
+    double best = INFINITY;
+    for (size_t n = 2; n < orbitr.size(); n++) {
+        for (size_t q = 1; q < n; q++) {
+            double distance = std::hypot(orbitr[n] - orbitr[q], orbiti[n] - orbiti[q]);
+            if (distance < best) {
+                best = distance;
+                preperiod = q;
+                period = n - q;
+            }
+        }
+    }
+    if (best == INFINITY) return false;
+
+    pointr.set_prec(precision + 32);
+    if (!newtonPoint(pointr, pointi, preperiod, period, cancel)) return false;
+    mpf_class distance(hypot(pointr - view.offsetx, pointi - view.offsety), precision);
+    if (cmp(distance, view.zoom) > 0) return false;
+    cr = pointr;
+    ci = pointi;
+    return true;
+}
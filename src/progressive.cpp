@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <future>
+#include <vector>
+#include "main.h"
+#include "frameBuffer.h"
+
+namespace {
+
+const int bandHeight = Frame::tileSize;
+
+// pixels that belong to the pass with this lattice step, i.e. on its lattice but not on
+// the coarser one of the previous pass
+bool inPass(int x, int y, int step) {
+    if (x % step != 0 || y % step != 0) return false;
+    if (step == 4) return true;
+    return x % (step * 2) != 0 || y % (step * 2) != 0;
+}
+
+// the previous pass' samples around a pixel of this pass: along the row, along the column,
+// or the four diagonals, depending on which coordinates are off the coarser lattice
+bool neighboursAgree(const Frame& frame, int x, int y, int step, MandelSample& agreed) {
+    int coarse = step * 2;
+    int dx = x % coarse != 0 ? step : 0;
+    int dy = y % coarse != 0 ? step : 0;
+    int candidates[4][2] = {{x - dx, y - dy}, {x + dx, y + dy}, {x - dx, y + dy}, {x + dx, y - dy}};
+    int count = dx != 0 && dy != 0 ? 4 : 2;
+    for (int i = 0; i < count; i++) {
+        int nx = candidates[i][0], ny = candidates[i][1];
+        // missing neighbours at the right/top edge, iterate to be safe
+        if (nx < 0 || ny < 0 || nx >= frame.width || ny >= frame.height) return false;
+        MandelSample sample = frame.samples[ny * frame.width + nx];
+        if (i == 0) agreed = sample;
+        else if (sample.iter != agreed.iter) return false;
+    }
+    return true;
+}
+
+// evaluate the pixels of one pass in rows [y0, y1), the coarsest pass always iterates
+void runPassBand(MandelJob& job, int step, int y0, int y1) {
+    const ViewSnapshot& view = job.view;
+    Frame& frame = *job.frame;
+    mpf_t cr, ci, temp;
+    mpf_init2(cr, view.precision);
+    mpf_init2(ci, view.precision);
+    mpf_init2(temp, view.precision);
+    long long iterated = 0;
+    for (int y = y0; y < y1 && !isCancelled(job); y++) {
+        for (int x = 0; x < frame.width; x++) {
+            if (!inPass(x, y, step)) continue;
+            MandelSample sample;
+            if (step == 4 || !neighboursAgree(frame, x, y, step, sample)) {
+                sample = evaluatePixel(job, x, y, cr, ci, temp, iterated);
+            }
+            frame.samples[y * frame.width + x] = sample;
+        }
+    }
+    mpf_clear(cr);
+    mpf_clear(ci);
+    mpf_clear(temp);
+    job.pixelsIterated += iterated;
+}
+
+void runPass(const std::shared_ptr<MandelJob>& job, int step) {
+    std::vector<std::future<void>> bands;
+    for (int y = 0; y < job->view.sizey; y += bandHeight) {
+        int y1 = std::min(y + bandHeight, job->view.sizey);
+        bands.push_back(job->pool.addTask([=]() { runPassBand(*job, step, y, y1); }, 0));
+    }
+    for (auto& band : bands) band.wait();
+}
+
+// every pixel takes the colour of the closest sample at or below/left of it on the lattice
+void publishPreview(MandelJob& job, int step) {
+    const Frame& frame = *job.frame;
+    auto preview = std::make_shared<std::vector<colour8>>(frame.width * frame.height);
+    for (int y = 0; y < frame.height; y++) {
+        for (int x = 0; x < frame.width; x += step) {
+            MandelSample sample = frame.samples[(y - y % step) * frame.width + x];
+            colour8 colour = sampleColour(sample, job.view.maxIter, job.view.gammaval);
+            std::fill_n(preview->begin() + y * frame.width + x, std::min(step, frame.width - x), colour);
+        }
+    }
+    job.frame->publishPreview(std::move(preview));
+}
+
+}
+
+// interlaced coarse to fine rendering: a pass on every 4th pixel in both directions, then
+// every 2nd, then the rest. after the first pass a pixel is only iterated if the samples of
+// the previous pass around it disagree, otherwise it takes their value. the display gets a
+// blocky preview after each coarse pass and the real tiles as the last pass finishes them
+bool computeMandelProgressive(std::shared_ptr<MandelJob> job) {
+    for (int step : {4, 2}) {
+        runPass(job, step);
+        if (isCancelled(*job)) return false;
+        publishPreview(*job, step);
+    }
+
+    for (int y = 0; y < job->view.sizey; y += bandHeight) {
+        int y1 = std::min(y + bandHeight, job->view.sizey);
+        job->pool.addTask([=]() {
+            runPassBand(*job, 1, y, y1);
+            if (isCancelled(*job)) return;
+            // only the colours are written, the samples of even rows are still being read by the
+            // neighbouring bands
+            Frame& frame = *job->frame;
+            for (int i = y * frame.width; i < y1 * frame.width; i++) {
+                frame.pixels[i] = sampleColour(frame.samples[i], job->view.maxIter, job->view.gammaval);
+            }
+            frame.markFinal(0, y, frame.width, y1);
+        }, 0);
+    }
+    return true;
+}
@@ -0,0 +1,172 @@
+#include "referenceOrbit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// chunks of all orbits that are backed by memory rather than the spill file, in bytes
+static std::atomic<size_t> residentBytes{0};
+
+ReferenceOrbit::ReferenceOrbit(uint64_t id, const mpf_class& cr, const mpf_class& ci, unsigned long precision)
+    : id(id)
+    , cr(cr, precision)
+    , ci(ci, precision)
+    , precision(precision)
+    , chunks(new Chunk[maxChunks])
+    , lastZr(cr, precision)
+    , lastZi(ci, precision) {
+    // z_0 = 0 and z_1 = c, every orbit is usable from the start
+    // the destructor doesn't run for a constructor that throws
+    if (!reserve()) {
+        release();
+        throw std::bad_alloc();
+    }
+    append({0, 0});
+    append({mpf_get_d(cr.get_mpf_t()), mpf_get_d(ci.get_mpf_t())});
+    published.store(2 | stoppedBit, std::memory_order_release);
+}
+
+ReferenceOrbit::~ReferenceOrbit() {
+    release();
+}
+
+void ReferenceOrbit::release() {
+    for (size_t i = 0; i < maxChunks && chunks[i].zr; i++) {
+        munmap(chunks[i].zr, chunkBytes);
+        if (!chunks[i].spilled) residentBytes -= chunkBytes;
+        chunks[i] = {};
+    }
+    if (spillFile >= 0) close(spillFile);
+    spillFile = -1;
+}
+
+bool ReferenceOrbit::allocateChunk(Chunk& chunk) {
+    void* memory = nullptr;
+    if (residentBytes.fetch_add(chunkBytes) + chunkBytes <= memoryBudget) {
+        // map twice the size and trim it to a huge page boundary, so the chunk can be one
+        void* mapping = mmap(nullptr, 2 * chunkBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED) {
+            char* start = (char*)mapping;
+            char* aligned = (char*)(((uintptr_t)start + chunkBytes - 1) & ~(uintptr_t)(chunkBytes - 1));
+            if (aligned != start) munmap(start, aligned - start);
+            if (aligned + chunkBytes != start + 2 * chunkBytes) munmap(aligned + chunkBytes, start + chunkBytes - aligned);
+            madvise(aligned, chunkBytes, MADV_HUGEPAGE);
+            memory = aligned;
+        }
+    }
+    if (!memory) {
+        residentBytes -= chunkBytes;
+        // spill to a file that only lives as long as the orbit
+        if (spillFile < 0) {
+            std::error_code error;
+            std::string path = (std::filesystem::temp_directory_path(error) / "mandel_orbit_XXXXXX").string();
+            if (error) return false;
+            spillFile = mkstemp(path.data());
+            if (spillFile < 0) return false;
+            unlink(path.c_str());
+        }
+        // the blocks are taken now, a sparse file would raise SIGBUS on a full disk at the first store
+        if (posix_fallocate(spillFile, spillSize, chunkBytes) != 0) return false;
+        memory = mmap(nullptr, chunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, spillFile, spillSize);
+        if (memory == MAP_FAILED) return false;
+        spillSize += chunkBytes;
+        // the pixels walk the orbit from the start, read it ahead when it comes back from disk
+        madvise(memory, chunkBytes, MADV_SEQUENTIAL);
+        chunk.spilled = true;
+    }
+    chunk.zr = (double*)memory;
+    chunk.zi = chunk.zr + chunkSize;
+    return true;
+}
+
+ReferenceOrbitCache::~ReferenceOrbitCache() {
+    stop();
+}
+
+bool ReferenceOrbitCache::covers(const ReferenceOrbit& orbit, const ViewSnapshot& view) {
+    if (orbit.precision < view.precision) return false;
+    mpf_class halfPixel(view.zoom / view.sizex / 2, view.precision);
+    mpf_class dx(abs(orbit.cr - view.offsetx), view.precision);
+    mpf_class dy(abs(orbit.ci - view.offsety), view.precision);
+    return cmp(dx, halfPixel * view.sizex) <= 0 && cmp(dy, halfPixel * view.sizey) <= 0;
+}
+
+// producer thread body, continues the orbit from where it stands up to z_maxIter, one
+// more than the pixels can use so the escape angle is covered
+void ReferenceOrbitCache::produce(std::shared_ptr<ReferenceOrbit> orbit, long long maxIter) {
+    unsigned long precision = orbit->precision;
+    mpf_t zr, zi, zrsqu, zisqu, temp;
+    mpf_init2(zr, precision);
+    mpf_init2(zi, precision);
+    mpf_init2(zrsqu, precision);
+    mpf_init2(zisqu, precision);
+    mpf_init2(temp, precision);
+    mpf_set(zr, orbit->lastZr.get_mpf_t());
+    mpf_set(zi, orbit->lastZi.get_mpf_t());
+
+    size_t end = std::min<size_t>(maxIter + 1, ReferenceOrbit::maxChunks * ReferenceOrbit::chunkSize);
+    while (orbit->length < end && !stopRequested.load(std::memory_order_relaxed)) {
+        // out of memory and disk, the orbit ends here
+        if (!orbit->reserve()) break;
+        mandelIterate(zr, zi, orbit->cr.get_mpf_t(), orbit->ci.get_mpf_t(), zrsqu, zisqu, temp);
+        orbit->append({mpf_get_d(zr), mpf_get_d(zi)});
+        mpf_mul(zrsqu, zr, zr);
+        mpf_mul(zisqu, zi, zi);
+        mpf_add(temp, zrsqu, zisqu);
+        if (mpf_cmp_ui(temp, 4) > 0) {
+            orbit->escaped.store(true, std::memory_order_release);
+            break;
+        }
+        // publishing wakes waiting workers, often enough that they rarely wait for long
+        if ((orbit->length & 63) == 0) orbit->publish(false);
+    }
+    mpf_set(orbit->lastZr.get_mpf_t(), zr);
+    mpf_set(orbit->lastZi.get_mpf_t(), zi);
+    orbit->publish(true);
+
+    mpf_clear(temp);
+    mpf_clear(zisqu);
+    mpf_clear(zrsqu);
+    mpf_clear(zi);
+    mpf_clear(zr);
+}
+
+void ReferenceOrbitCache::stop() {
+    stopRequested = true;
+    if (producer.joinable()) producer.join();
+    stopRequested = false;
+    producing.reset();
+}
+
+std::shared_ptr<const ReferenceOrbit> ReferenceOrbitCache::acquire(const ViewSnapshot& view) {
+    std::shared_ptr<ReferenceOrbit> orbit;
+    for (size_t i = 0; i < orbits.size(); i++) {
+        if (!covers(*orbits[i], view)) continue;
+        orbit = orbits[i];
+        orbits.erase(orbits.begin() + i);
+        break;
+    }
+    if (!orbit) {
+        orbit = std::make_shared<ReferenceOrbit>(nextID++, mpf_class(view.offsetx, view.precision),
+                                                 mpf_class(view.offsety, view.precision), view.precision);
+    }
+    orbits.insert(orbits.begin(), orbit);
+    if (orbits.size() > maxOrbits) orbits.pop_back();
+
+    // nothing to do if this orbit is already being produced far enough
+    if (orbit == producing && producingTarget >= view.maxIter) return orbit;
+    // otherwise the producer moves over. an orbit that is cut short stays correct as far as
+    // it goes and is continued from there the next time it is needed
+    stop();
+    if (!orbit->isEscaped() && (long long)orbit->length <= view.maxIter) {
+        producing = orbit;
+        producingTarget = view.maxIter;
+        orbit->publish(false);
+        producer = std::thread(&ReferenceOrbitCache::produce, this, orbit, view.maxIter);
+    }
+    return orbit;
+}
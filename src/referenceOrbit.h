@@ -0,0 +1,140 @@
+#ifndef REFERENCE_ORBIT_H
+#define REFERENCE_ORBIT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "main.h"
+
+// orbit of one point c = (cr, ci) iterated at full precision, stored as doubles for the
+// perturbation kernel. a producer thread appends to it while pixels are already being
+// iterated against the prefix that is ready: entries live in fixed size chunks that never
+// move, and the published length is bumped after the entries are written, so readers only
+// synchronise on that one word. a reader that catches up with the producer blocks on it.
+// each chunk is one 2 MiB huge page holding the real parts followed by the imaginary parts.
+// once all orbits together hold more than memoryBudget, further chunks are mapped from an
+// unlinked file instead, so very long orbits page out rather than exhaust memory
+class ReferenceOrbit {
+public:
+    struct Entry {
+        double zr;
+        double zi;
+    };
+
+    static constexpr size_t memoryBudget = size_t(1) << 30;
+
+    // throws std::bad_alloc if not even the first chunk can be had
+    ReferenceOrbit(uint64_t id, const mpf_class& cr, const mpf_class& ci, unsigned long precision);
+    ~ReferenceOrbit();
+    ReferenceOrbit(const ReferenceOrbit&) = delete;
+    ReferenceOrbit& operator=(const ReferenceOrbit&) = delete;
+
+    Entry operator[](size_t index) const {
+        const Chunk& chunk = chunks[index >> chunkBits];
+        size_t offset = index & (chunkSize - 1);
+        return {chunk.zr[offset], chunk.zi[offset]};
+    }
+
+    // number of entries that may be read right now
+    size_t available() const {
+        return published.load(std::memory_order_acquire) & ~stoppedBit;
+    }
+
+    // blocks until entry index is available or nothing is producing any more, returns available()
+    size_t waitFor(size_t index) const {
+        for (;;) {
+            uint64_t word = published.load(std::memory_order_acquire);
+            size_t length = word & ~stoppedBit;
+            if (length > index || (word & stoppedBit)) return length;
+            published.wait(word, std::memory_order_acquire);
+        }
+    }
+
+    bool isEscaped() const {
+        return escaped.load(std::memory_order_acquire);
+    }
+
+    const uint64_t id; // an extended orbit keeps its id, the prefix doesn't change
+    const mpf_class cr;
+    const mpf_class ci;
+    const unsigned long precision;
+
+private:
+    friend class ReferenceOrbitCache;
+
+    struct Chunk {
+        double* zr = nullptr;
+        double* zi = nullptr;
+        bool spilled = false;
+    };
+
+    static constexpr size_t chunkBytes = size_t(2) << 20;
+    static constexpr int chunkBits = 17; // doubles in half a chunk
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+    static constexpr size_t maxChunks = 4096; // 2^29 iterations
+    static constexpr uint64_t stoppedBit = uint64_t(1) << 63;
+
+    // producer side: room for the next entry, false if out of memory and disk
+    bool reserve() {
+        return (length & (chunkSize - 1)) != 0 || allocateChunk(chunks[length >> chunkBits]);
+    }
+
+    // entries only become visible with publish
+    void append(Entry entry) {
+        Chunk& chunk = chunks[length >> chunkBits];
+        chunk.zr[length & (chunkSize - 1)] = entry.zr;
+        chunk.zi[length & (chunkSize - 1)] = entry.zi;
+        length++;
+    }
+
+    void publish(bool stopped) {
+        published.store(length | (stopped ? stoppedBit : 0), std::memory_order_release);
+        published.notify_all();
+    }
+
+    bool allocateChunk(Chunk& chunk);
+    // unmaps every chunk and closes the spill file
+    void release();
+
+    std::unique_ptr<Chunk[]> chunks;
+    int spillFile = -1;
+    size_t spillSize = 0;
+    size_t length = 0; // producer's count, ahead of published
+    std::atomic<uint64_t> published{0};
+    std::atomic<bool> escaped{false};
+    // where the full precision orbit stands, only touched by the producer
+    mpf_class lastZr;
+    mpf_class lastZi;
+};
+
+// recently used reference orbits and the thread that computes them. a frame reuses an orbit
+// whose centre is inside its view and whose precision is enough, extending it if it is
+// shorter than maxIter; otherwise a new orbit is started at the view's centre. there is one
+// producer, switching to another orbit stops the previous one where it is. acquire and stop
+// are only called from the render coordinator thread
+class ReferenceOrbitCache {
+public:
+    ~ReferenceOrbitCache();
+
+    // the orbit to render a view against, production up to maxIter is under way on return
+    std::shared_ptr<const ReferenceOrbit> acquire(const ViewSnapshot& view);
+    // stop producing, waiting readers fall back to what is there
+    void stop();
+
+private:
+    static constexpr size_t maxOrbits = 4;
+
+    static bool covers(const ReferenceOrbit& orbit, const ViewSnapshot& view);
+    void produce(std::shared_ptr<ReferenceOrbit> orbit, long long maxIter);
+
+    std::vector<std::shared_ptr<ReferenceOrbit>> orbits; // most recently used first
+    uint64_t nextID = 1;
+    std::thread producer;
+    std::atomic<bool> stopRequested{false};
+    std::shared_ptr<ReferenceOrbit> producing;
+    long long producingTarget = 0;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "../src/glad/glad.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <chrono>
 #include <future>
 #include <gmp.h>
@@ -13,10 +14,14 @@
 #include "utils.h"
 #include "render.h"
 #include "main.h"
+#include "renderCoordinator.h"
+#include "frameBuffer.h"
+#include "textureStreamer.h"
+#include "tileCache.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window);
+void window_refresh_callback(GLFWwindow* window);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -26,8 +31,59 @@ mpf_t offsety;
 mpf_t zoom;
 double gammaval = 0.01;
 long long iters = 10000;
-bool computeNewFrame;
-long long unsigned int mandelFrameID = 0;
+RenderAlgorithm renderAlgorithm = RenderAlgorithm::MarianiSilver;
+bool antiAlias = false;
+bool perturbation = true;
+bool autoIters = false;
+bool distanceEstimation = false;
+bool certifiedFill = false;
+// where the tiles of a frame start, the user looks at the centre (where a click zooms to) or the cursor
+enum class TileOrder { Centre, Cursor, LongestFirst };
+TileOrder tileOrder = TileOrder::Centre;
+double cursorX = -1, cursorY = -1;
+bool computeNewFrame = true;
+bool redrawNeeded = true;
+bool exportRequested = false;
+// newton jumps, requested by key with the cursor position and solved in the background
+enum class JumpKind { None, Minibrot, Misiurewicz };
+JumpKind jumpRequested = JumpKind::None;
+double jumpCursorX, jumpCursorY;
+struct JumpTarget {
+    bool found = false;
+    mpf_class cr, ci, zoom;
+};
+// left button drag state, a press and release without movement is a zoom click
+bool leftButtonDown = false;
+bool dragged = false;
+double dragStartX, dragStartY;
+long dragAppliedX, dragAppliedY;
+const int dragThreshold = 3;
+const double idleWakeSeconds = 0.5; // upper bound on how long the loop sleeps without any event
+int poolMetricsIntervalMs = 0; // print thread pool metrics this often, 0 disables
+std::string tileCachePath = "mandel_tiles.cache"; // rendered tiles persist here across sessions, empty disables
+
+// deep copy of the current view for the render coordinator, the globals keep
+// being edited by the input callbacks while the frame renders
+ViewSnapshot takeViewSnapshot(int width, int height)
+{
+    unsigned long precision = precisionForZoom(zoom);
+    ViewSnapshot view{width, height, iters, gammaval, true, precision,
+                      mpf_class(offsetx, precision), mpf_class(offsety, precision), mpf_class(zoom, precision),
+                      renderAlgorithm, antiAlias, perturbation, autoIters, distanceEstimation,
+                      certifiedFill};
+    if (tileOrder == TileOrder::Centre || (tileOrder == TileOrder::Cursor && cursorX < 0)) {
+        view.focused = true;
+        view.focusX = width / 2.0;
+        view.focusY = height / 2.0;
+    } else if (tileOrder == TileOrder::Cursor) {
+        // screen y points down, pixel rows up
+        view.focused = true;
+        view.focusX = cursorX;
+        view.focusY = height - cursorY;
+    }
+    snapToLattice(view);
+    return view;
+}
 
 void runGraphicsEngine()
 {
@@ -58,6 +114,9 @@ void runGraphicsEngine()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -150,17 +209,17 @@ void runGraphicsEngine()
     // load image, create texture
     int scrwidth, scrheight;
     glfwGetWindowSize(window, &scrwidth, &scrheight);
-    std::vector<colour8> data1(scrwidth * scrheight);
-
-    int oldscrwidth, oldscrheight;
-
+    // workers wake the loop when a tile lands, at most one wakeup is queued at a time
+    std::atomic<bool> wakePending = false;
+    FrameBuffer frameBuffer;
+    frameBuffer.setTileListener([&wakePending]() {
+        if (!wakePending.exchange(true)) glfwPostEmptyEvent();
+    });
     ThreadPool pool(std::thread::hardware_concurrency() * 4);
+    if (poolMetricsIntervalMs > 0) pool.startMetricsDump(std::chrono::milliseconds(poolMetricsIntervalMs));
+    RenderCoordinator coordinator(pool, frameBuffer, tileCachePath);
 
-    std::promise<bool> promise;
-    std::future<bool> completed = promise.get_future();
-    promise.set_value(true);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, scrwidth, scrheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data1.data());
+    TextureStreamer streamer(texture2);
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     // -------------------------------------------------------------------------------------------
@@ -168,93 +227,213 @@ void runGraphicsEngine()
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
 
-    std::vector<colour8> dataCopy;
+    std::future<JumpTarget> jump;
+    // set on the way out, a search still running gives up instead of holding up exit
+    std::atomic<bool> jumpCancelled = false;
 
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {   
         glfwGetWindowSize(window, &scrwidth, &scrheight);
-        data1.resize(oldscrwidth*oldscrheight);
-        auto status = completed.wait_for(std::chrono::seconds(0));
+        // the coordinator already renders with what it chose, later views start from it
+        if (autoIters && coordinator.autoMaxIter() > 0 && coordinator.autoMaxIter() != iters) {
+            iters = coordinator.autoMaxIter();
+            std::cout << "max iters: " << iters << " (auto)" << std::endl;
+        }
         if (computeNewFrame == true) {
             computeNewFrame = false;
-            if (!completed.get() == true) break;
-            // At this point, ensure no tasks are still writing to data1.
-            oldscrwidth = scrwidth;
-            oldscrheight = scrheight;
-            pool.purge();
-            mandelFrameID++;
-            completed = std::async(std::launch::async, [=, &data1, &pool]() {
-                auto result = computeMandel(oldscrwidth, oldscrheight, iters, data1, offsetx, offsety, zoom, gammaval, true, pool, mandelFrameID);
-                return result;
+            coordinator.requestFrame(takeViewSnapshot(scrwidth, scrheight));
+        }
+        if (jumpRequested != JumpKind::None && !jump.valid()) {
+            ViewSnapshot view = takeViewSnapshot(scrwidth, scrheight);
+            // screen y points down, pixel rows up
+            double x = jumpCursorX, y = scrheight - jumpCursorY;
+            bool minibrot = jumpRequested == JumpKind::Minibrot;
+            // on its own thread, a new frame purges the pool's queue and a queued search with it
+            jump = std::async(std::launch::async, [view, x, y, minibrot, &jumpCancelled]() {
+                JumpTarget target;
+                long long preperiod = 0, period = 0;
+                if (minibrot) {
+                    target.found = findMinibrot(view, x, y, target.cr, target.ci, target.zoom, period, &jumpCancelled);
+                    if (target.found) std::cout << "minibrot of period " << period << std::endl;
+                } else {
+                    target.found = findMisiurewicz(view, x, y, target.cr, target.ci, preperiod, period, &jumpCancelled);
+                    target.zoom = view.zoom;
+                    if (target.found) std::cout << "misiurewicz point " << preperiod << "/" << period << std::endl;
+                }
+                if (!target.found) std::cout << "nothing found near the cursor" << std::endl;
+                glfwPostEmptyEvent();
+                return target;
             });
         }
-        dataCopy = data1;
-        dataCopy.resize(oldscrwidth*oldscrheight);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, oldscrwidth, oldscrheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, dataCopy.data());
-        // input
-        // -----
-        processInput(window);
-
-        // render
-        // ------
-        glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
-
-        // render container
-        ourShader.use();
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        jumpRequested = JumpKind::None;
+        if (jump.valid() && jump.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            JumpTarget target = jump.get();
+            if (target.found) jumpTo(target.cr, target.ci, target.zoom);
+        }
+        std::shared_ptr<Frame> frame = frameBuffer.acquire();
+        if (frame && streamer.update(frame)) redrawNeeded = true;
+        if (exportRequested) {
+            exportRequested = false;
+            // a partial frame would export stale buffer contents
+            if (frame && frame->isComplete()) {
+                writeRawImg(frame->width, frame->height, frame->pixels);
+                std::cout << "wrote mandel.ppm" << std::endl;
+            } else {
+                std::cout << "frame still rendering, not exported" << std::endl;
+            }
+        }
+
+        if (redrawNeeded) {
+            redrawNeeded = false;
+
+            // render
+            // ------
+            glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // bind textures on corresponding texture units
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture1);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, texture2);
+
+            // render container
+            ourShader.use();
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+            // glfw: swap buffers
+            // ------------------
+            glfwSwapBuffers(window);
+        }
+
+        // glfw: sleep until there is input or a tile has been published, the callbacks set the flags
+        // ---------------------------------------------------------------------------------------------
+        glfwWaitEventsTimeout(idleWakeSeconds);
+        wakePending = false;
     }
 
+    // no worker may call back into glfw once it has been terminated
+    coordinator.shutdown();
+    pool.shutdown();
+
+    // the search posts to glfw when it is done, it has to be over before glfw is
+    jumpCancelled = true;
+    if (jump.valid()) jump.wait();
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    streamer.release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// process keyboard input: glfw calls this on press and on key repeat, so holding a key keeps
+// adjusting without the loop having to poll
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    if (action == GLFW_RELEASE) return;
+    if (key == GLFW_KEY_ESCAPE) {
         glfwSetWindowShouldClose(window, true);
         computeNewFrame = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+    if ((key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) && autoIters) {
+        autoIters = false;
+        std::cout << "auto max iters: off" << std::endl;
+    }
+    if (key == GLFW_KEY_UP) {
         iters *= 1.1;
         std::cout << "max iters: " << iters << std::endl;
         computeNewFrame = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+    if (key == GLFW_KEY_DOWN) {
         std::cout << "max iters: " << iters << std::endl;
         iters /= 1.1;
         computeNewFrame = true;
     }
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        switch (renderAlgorithm) {
+            case RenderAlgorithm::MarianiSilver: renderAlgorithm = RenderAlgorithm::BoundaryTrace; break;
+            case RenderAlgorithm::BoundaryTrace: renderAlgorithm = RenderAlgorithm::Progressive; break;
+            case RenderAlgorithm::Progressive: renderAlgorithm = RenderAlgorithm::MarianiSilver; break;
+        }
+        std::cout << "algorithm: " << algorithmName(renderAlgorithm) << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        antiAlias = !antiAlias;
+        std::cout << "anti-aliasing: " << (antiAlias ? "on" : "off") << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        perturbation = !perturbation;
+        std::cout << "perturbation: " << (perturbation ? "on" : "off") << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        autoIters = !autoIters;
+        std::cout << "auto max iters: " << (autoIters ? "on" : "off") << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+        distanceEstimation = !distanceEstimation;
+        std::cout << "distance estimation: " << (distanceEstimation ? "on" : "off") << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        certifiedFill = !certifiedFill;
+        std::cout << "certified fill: " << (certifiedFill ? "on" : "off") << std::endl;
+        computeNewFrame = true;
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        // only the order tiles are scheduled in, the next frame picks it up
+        switch (tileOrder) {
+            case TileOrder::Centre: tileOrder = TileOrder::Cursor; break;
+            case TileOrder::Cursor: tileOrder = TileOrder::LongestFirst; break;
+            case TileOrder::LongestFirst: tileOrder = TileOrder::Centre; break;
+        }
+        const char* names[] = {"centre first", "cursor first", "longest first"};
+        std::cout << "tile order: " << names[(int)tileOrder] << std::endl;
+    }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        exportRequested = true;
+    }
+    if ((key == GLFW_KEY_N || key == GLFW_KEY_M) && action == GLFW_PRESS) {
+        // N: zoom straight to the next minibrot near the cursor, M: centre the misiurewicz point there
+        jumpRequested = key == GLFW_KEY_N ? JumpKind::Minibrot : JumpKind::Misiurewicz;
+        glfwGetCursorPos(window, &jumpCursorX, &jumpCursorY);
+    }
+    if (key == GLFW_KEY_W || key == GLFW_KEY_A || key == GLFW_KEY_S || key == GLFW_KEY_D) {
+        int windowx, windowy;
+        glfwGetWindowSize(window, &windowx, &windowy);
+        int step = std::max(1, windowx / 10);
+        if (key == GLFW_KEY_W) panPixels(windowx, 0, step);
+        if (key == GLFW_KEY_S) panPixels(windowx, 0, -step);
+        if (key == GLFW_KEY_A) panPixels(windowx, -step, 0);
+        if (key == GLFW_KEY_D) panPixels(windowx, step, 0);
+    }
 
 }
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
     mpf_t temp3, temp4, zoomFactor;
     mpf_init_set_d(zoomFactor, 10);
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        leftButtonDown = true;
+        dragged = false;
+        glfwGetCursorPos(window, &dragStartX, &dragStartY);
+        dragAppliedX = 0;
+        dragAppliedY = 0;
+    }
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE && leftButtonDown && !dragged) {
+        leftButtonDown = false;
         double mousexpos, mouseypos;
         int windowx, windowy;
         glfwGetCursorPos(window, &mousexpos, &mouseypos);
@@ -274,6 +453,9 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         gmp_printf("r: %.*Ff \ni: %.*Ff \nzoom: %#Fe\nbits: %d\n", digits, offsetx, digits, offsety, zoom, prec_bits);
         computeNewFrame = true;
     }
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
+        leftButtonDown = false;
+    }
     if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
         mpf_mul(zoom, zoom, zoomFactor);
         unsigned long prec_bits = mpf_get_prec(zoom);
@@ -284,16 +466,61 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
     if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
         computeNewFrame = true;
     }
-    double zoomd = mpf_get_d(zoom);
-    long bitsl = -std::log2(zoomd);
-    bitsl = (bitsl >= 0) * bitsl;
-    bitsl = bitsl/32 * 32 + 64;
+    unsigned long bitsl = precisionForZoom(zoom);
     mpf_set_default_prec(bitsl);
 
     mpf_set_prec(offsetx, bitsl);
     mpf_set_prec(offsety, bitsl);
     mpf_set_prec(zoom, bitsl);
 }
+// centre the view on (cr, ci) at zoom, the finder hands over cr at the precision that zoom needs
+void jumpTo(const mpf_class& cr, const mpf_class& ci, const mpf_class& newZoom) {
+    unsigned long bitsl = cr.get_prec();
+    mpf_set_default_prec(bitsl);
+    mpf_set_prec(offsetx, bitsl);
+    mpf_set_prec(offsety, bitsl);
+    mpf_set_prec(zoom, bitsl);
+    mpf_set(offsetx, cr.get_mpf_t());
+    mpf_set(offsety, ci.get_mpf_t());
+    mpf_set(zoom, newZoom.get_mpf_t());
+    unsigned long digits = (unsigned long)std::ceil(bitsl * 0.30103);
+    gmp_printf("r: %.*Ff \ni: %.*Ff \nzoom: %#Fe\nbits: %d\n", digits, offsetx, digits, offsety, zoom, bitsl);
+    computeNewFrame = true;
+}
+// move the view by whole pixels (positive is right/up), that way the previous frame lines
+// up with the new one and only the strips scrolled into view have to be computed
+void panPixels(int windowx, long dx, long dy) {
+    mpf_t step;
+    mpf_init2(step, mpf_get_prec(zoom));
+    mpf_div_ui(step, zoom, windowx);
+    mpf_t shift;
+    mpf_init2(shift, mpf_get_prec(zoom));
+    mpf_mul_ui(shift, step, std::labs(dx));
+    if (dx > 0) mpf_add(offsetx, offsetx, shift);
+    else mpf_sub(offsetx, offsetx, shift);
+    mpf_mul_ui(shift, step, std::labs(dy));
+    if (dy > 0) mpf_add(offsety, offsety, shift);
+    else mpf_sub(offsety, offsety, shift);
+    mpf_clear(step);
+    mpf_clear(shift);
+    computeNewFrame = true;
+}
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+    cursorX = xpos;
+    cursorY = ypos;
+    if (!leftButtonDown) return;
+    long totalx = std::lround(xpos - dragStartX);
+    long totaly = std::lround(ypos - dragStartY);
+    if (!dragged && std::labs(totalx) < dragThreshold && std::labs(totaly) < dragThreshold) return;
+    dragged = true;
+    if (totalx == dragAppliedX && totaly == dragAppliedY) return;
+    int windowx, windowy;
+    glfwGetWindowSize(window, &windowx, &windowy);
+    // the image follows the cursor, so the view moves the opposite way (screen y points down)
+    panPixels(windowx, -(totalx - dragAppliedX), totaly - dragAppliedY);
+    dragAppliedX = totalx;
+    dragAppliedY = totaly;
+}
 void scroll_callback(GLFWwindow* window, double scrollxoffset, double scrollyoffset) {
     gammaval *= std::exp(scrollyoffset/20);
     //std::cout << gammaval << std::endl;
@@ -306,4 +533,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
     computeNewFrame = true;
+    redrawNeeded = true;
+}
+// glfw: the window contents were damaged (uncovered, restored...) and have to be drawn again
+void window_refresh_callback(GLFWwindow* window)
+{
+    redrawNeeded = true;
 }
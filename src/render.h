@@ -4,6 +4,7 @@ void runGraphicsEngine();
 
 #include "../src/glad/glad.h"
 #include <GLFW/glfw3.h>
+#include <gmpxx.h>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -122,4 +123,8 @@ private:
 #endif
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
-void scroll_callback(GLFWwindow* window, double scrollxoffset, double scrollyoffset);
\ No newline at end of file
+void scroll_callback(GLFWwindow* window, double scrollxoffset, double scrollyoffset);
+void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
+void panPixels(int windowx, long dx, long dy);
+void jumpTo(const mpf_class& cr, const mpf_class& ci, const mpf_class& newZoom);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
\ No newline at end of file
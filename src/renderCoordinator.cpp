@@ -0,0 +1,207 @@
+#include "renderCoordinator.h"
+#include "costMap.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+RenderCoordinator::RenderCoordinator(ThreadPool& pool, FrameBuffer& frameBuffer, const std::string& tileCachePath)
+    : pool(pool)
+    , frameBuffer(frameBuffer)
+    , tileCache(tileCacheBytes, tileCachePath, diskTileCacheBytes) {
+    thread = std::thread(&RenderCoordinator::coordinatorFunction, this);
+}
+
+RenderCoordinator::~RenderCoordinator() {
+    shutdown();
+}
+
+void RenderCoordinator::requestFrame(ViewSnapshot view) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!pending) burstStart = now;
+        lastRequest = now;
+        pending = std::move(view);
+        // cancel whatever is in flight right away, it can never be shown now
+        latestFrameID++;
+        globalMandelFrameID = latestFrameID;
+    }
+    conditionVariable.notify_one();
+}
+
+void RenderCoordinator::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutdownRequested = true;
+        globalMandelFrameID = ++latestFrameID;
+    }
+    conditionVariable.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    // workers waiting for more of a reference orbit carry on without it
+    referenceOrbits.stop();
+    pool.purge();
+}
+
+void RenderCoordinator::frameCompleted(std::shared_ptr<MandelJob> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        referenceJob = job;
+        completedJob = std::move(job);
+    }
+    conditionVariable.notify_one();
+}
+
+void RenderCoordinator::coordinatorFunction() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        conditionVariable.wait(lock, [this] {
+            return shutdownRequested || pending.has_value() || completedJob;
+        });
+        if (shutdownRequested) return;
+
+        if (completedJob) {
+            std::shared_ptr<MandelJob> job = std::move(completedJob);
+            completedJob.reset();
+            // only if nothing newer was asked for is the finished frame what stays on screen
+            bool current = job->frameID == latestFrameID;
+            lock.unlock();
+            tileCache.insert(*job);
+            if (current) finishFrame(job);
+            lock.lock();
+            continue;
+        }
+
+        // let the burst settle so e.g. a held key doesn't start a frame per repeat
+        for (;;) {
+            auto deadline = std::min(lastRequest + coalesceWindow, burstStart + maxCoalesceDelay);
+            if (std::chrono::steady_clock::now() >= deadline) break;
+            conditionVariable.wait_until(lock, deadline);
+            if (shutdownRequested) return;
+        }
+
+        ViewSnapshot view = std::move(*pending);
+        long long unsigned int frameID = latestFrameID;
+        pending.reset();
+        std::shared_ptr<MandelJob> reference = referenceJob;
+        lock.unlock();
+
+        PixelMapping mapping;
+        bool mapped = reference && pixelMapping(reference->view, view, mapping);
+        // pixels only line up at the same maxIter, pans and zoom outs keep the last frame's.
+        // a view that starts over anyway, e.g. a zoom in, takes the lower one it asked for
+        if (reference && reference->frameID == loweredFrameID && loweredMaxIter > 0 && view.autoMaxIter
+            && view.maxIter == reference->view.maxIter && !mapped && !sameViewport(reference->view, view)) {
+            view.maxIter = loweredMaxIter;
+            chosenMaxIter = loweredMaxIter;
+        }
+
+        // a fresh back buffer per frame, stragglers of the old frame can't touch it
+        std::shared_ptr<Frame> frame = frameBuffer.beginFrame(view.sizex, view.sizey, frameID);
+        auto job = std::make_shared<MandelJob>(std::move(view), frame, pool, frameID);
+        // weak, the frame must not keep its own job alive
+        frame->onComplete = [this, weakJob = std::weak_ptr<MandelJob>(job)]() {
+            if (auto job = weakJob.lock()) {
+                reportFrameStats(*job);
+                frameCompleted(job);
+            }
+        };
+
+        // tasks of superseded frames return immediately once they run, but there is
+        // no point letting them sit in the queue ahead of the new frame
+        pool.purge();
+        std::vector<ScreenRect> missing = {{0, 0, job->view.sizex, job->view.sizey}};
+        bool wholeFrame = false;
+        if (mapped) {
+            // a pan by whole pixels only needs the strips that scrolled into view, a zoom
+            // out only the surround of the old frame shrunk into the centre. that shrunk
+            // frame is shown meanwhile rather than the old one at its old size
+            if (mapping.scale > 1) publishReprojection(*job, *reference->frame, reference->view);
+            missing = tileCache.serve(*job, reuseFrame(*job, *reference->frame, mapping));
+        } else {
+            if (reference && sameViewport(reference->view, job->view)) {
+                // only maxIter changed, continue the old orbits instead of starting over
+                job->resumeFrame = reference->frame;
+                job->resumeMaxIter = reference->view.maxIter;
+            }
+            // e.g. a zoom in, show the old frame magnified until the new tiles land
+            if (reference) publishReprojection(*job, *reference->frame, reference->view);
+            if (!job->resumeFrame) missing = tileCache.serve(*job, missing);
+            // partly cached frames fill the gaps with mariani-silver, the chosen algorithm
+            // only ever runs on whole frames
+            wholeFrame = missing.size() == 1 && missing[0].x0 == 0 && missing[0].y0 == 0
+                      && missing[0].x1 == job->view.sizex && missing[0].y1 == job->view.sizey;
+        }
+
+        // the serial part of a deep frame, whatever could be reused is on screen meanwhile
+        if (!missing.empty() && usePerturbation(job->view)) prepareReference(*job);
+        // where the last frame spent its iterations, so the slowest parts of this one start first
+        bool marianiSilver = !wholeFrame || job->view.algorithm == RenderAlgorithm::MarianiSilver;
+        if (!missing.empty() && reference && marianiSilver) {
+            auto cost = std::make_shared<const CostMap>(*reference->frame, reference->view, job->view);
+            if (!cost->empty()) job->cost = std::move(cost);
+        }
+
+        if (wholeFrame) {
+            computeMandel(job);
+        } else {
+            computeMandelRegions(job, missing);
+        }
+
+        lock.lock();
+    }
+}
+
+void RenderCoordinator::prepareReference(MandelJob& job) {
+    try {
+        job.reference = referenceOrbits.acquire(job.view);
+    } catch (const std::bad_alloc&) {
+        // no memory or disk left even for the start of an orbit, the mpf kernel needs none
+        std::cout << "no room for a reference orbit, rendering without perturbation" << std::endl;
+        return;
+    }
+    const ViewSnapshot& view = job.view;
+    job.referenceOffsetX = mpf_class(view.offsetx - job.reference->cr, view.precision).get_d();
+    job.referenceOffsetY = mpf_class(view.offsety - job.reference->ci, view.precision).get_d();
+    job.pixelSize = mpf_class(view.zoom / view.sizex, view.precision).get_d();
+}
+
+// post-processing of a frame that rendered to completion and is still the newest
+void RenderCoordinator::finishFrame(std::shared_ptr<MandelJob> job) {
+    // no point smoothing a frame that is about to get more iterations
+    if (job->view.autoMaxIter && adjustMaxIter(*job)) return;
+    if (job->view.antiAlias) {
+        // anti-aliased pixels go to a new back buffer, the display keeps showing the
+        // aliased frame until the smoothed tiles replace it
+        std::shared_ptr<Frame> smoothed = frameBuffer.beginFrame(job->view.sizex, job->view.sizey, job->frameID);
+        auto aaJob = std::make_shared<MandelJob>(job->view, smoothed, pool, job->frameID);
+        computeAntiAlias(aaJob, job->frame);
+    }
+}
+
+// pick maxIter for an auto frame from how it came out. a higher one re-renders the same
+// view, which resumes the unescaped pixels only; a lower one is left for the next view that
+// can't reuse this frame anyway
+bool RenderCoordinator::adjustMaxIter(const MandelJob& job) {
+    long long suggested = suggestMaxIter(job);
+    loweredMaxIter = suggested < job.view.maxIter ? suggested : 0;
+    loweredFrameID = job.frameID;
+    if (suggested <= job.view.maxIter) {
+        chosenMaxIter = job.view.maxIter;
+        return false;
+    }
+    chosenMaxIter = suggested;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // whatever the user asked for meanwhile wins
+        if (pending || job.frameID != latestFrameID) return false;
+        pending = job.view;
+        pending->maxIter = suggested;
+        burstStart = lastRequest = std::chrono::steady_clock::now() - maxCoalesceDelay;
+        latestFrameID++;
+        globalMandelFrameID = latestFrameID;
+    }
+    conditionVariable.notify_one();
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef RENDER_COORDINATOR_H
+#define RENDER_COORDINATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "main.h"
+#include "frameBuffer.h"
+#include "tileCache.h"
+#include "referenceOrbit.h"
+
+// long-lived thread that owns frame scheduling. the ui thread hands it view snapshots,
+// bursts of requests are coalesced and only the newest one is ever rendered; anything
+// older is cancelled through globalMandelFrameID as soon as it is superseded
+class RenderCoordinator {
+public:
+    // tiles are cached on disk in tileCachePath unless it is empty
+    RenderCoordinator(ThreadPool& pool, FrameBuffer& frameBuffer, const std::string& tileCachePath = "");
+    ~RenderCoordinator();
+
+    void requestFrame(ViewSnapshot view);
+    void shutdown();
+    // maxIter chosen for views with autoMaxIter, 0 until there is one
+    long long autoMaxIter() const { return chosenMaxIter.load(std::memory_order_relaxed); }
+
+private:
+    void coordinatorFunction();
+    // called by the worker that finished the last tile
+    void frameCompleted(std::shared_ptr<MandelJob> job);
+    void finishFrame(std::shared_ptr<MandelJob> job);
+    bool adjustMaxIter(const MandelJob& job);
+    void prepareReference(MandelJob& job);
+
+    // wait this long after the last request of a burst before starting a frame,
+    // but never hold a request back longer than maxCoalesceDelay (e.g. a held key)
+    static constexpr std::chrono::milliseconds coalesceWindow{15};
+    static constexpr std::chrono::milliseconds maxCoalesceDelay{100};
+    static constexpr size_t tileCacheBytes = size_t(256) << 20;
+    static constexpr size_t diskTileCacheBytes = size_t(1) << 30;
+
+    ThreadPool& pool;
+    FrameBuffer& frameBuffer;
+    TileCache tileCache;
+    ReferenceOrbitCache referenceOrbits;
+
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+    std::optional<ViewSnapshot> pending;
+    std::shared_ptr<MandelJob> completedJob;
+    // newest frame that rendered to completion, new frames copy what they can from it
+    std::shared_ptr<MandelJob> referenceJob;
+    std::chrono::steady_clock::time_point burstStart;
+    std::chrono::steady_clock::time_point lastRequest;
+    long long unsigned int latestFrameID = 0;
+    std::atomic<long long> chosenMaxIter{0};
+    // lower maxIter the frame loweredFrameID would have done with, 0 if none
+    long long loweredMaxIter = 0;
+    long long unsigned int loweredFrameID = 0;
+    bool shutdownRequested = false;
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "textureStreamer.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+TextureStreamer::TextureStreamer(unsigned int texture)
+    : texture(texture)
+    , persistent(GLAD_GL_VERSION_4_4) {
+}
+
+void TextureStreamer::release() {
+    destroyBuffers();
+    shownFrame.reset();
+}
+
+bool TextureStreamer::update(const std::shared_ptr<const Frame>& frame) {
+    if (frame == shownFrame && frame->generation() == shownGeneration && frame->previewVersion() == shownPreview) return false;
+
+    if (frame != shownFrame) {
+        shownFrame = frame;
+        shownTiles.assign(frame->tilesX * frame->tilesY, false);
+        shownGeneration = 0;
+        shownPreview = 0;
+        if (frame->width != width || frame->height != height) resize(frame->width, frame->height);
+    }
+
+    bool changed = false;
+    if (frame->previewVersion() != shownPreview) {
+        shownPreview = frame->previewVersion();
+        if (auto preview = frame->acquirePreview()) {
+            upload(preview->data(), frame->width, {{0, 0, frame->width, frame->height}});
+            // finished tiles are better than the preview, put them back on top
+            shownTiles.assign(shownTiles.size(), false);
+            changed = true;
+        }
+    }
+
+    // read the generation before the bitmap, a tile finishing in between is picked up next time
+    shownGeneration = frame->generation();
+
+    std::vector<DirtyRect> rects = collectDirtyRects(*frame);
+    if (rects.empty()) return changed;
+    upload(frame->pixels.data(), frame->width, rects);
+    return true;
+}
+
+// respecify storage only when the window size changes, everything else is a sub-image update
+void TextureStreamer::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    std::vector<colour8> black(width * height, colour8{0, 0, 0, 255});
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, black.data());
+
+    destroyBuffers();
+    bufferSize = (size_t)width * height * sizeof(colour8);
+    createBuffers();
+}
+
+void TextureStreamer::createBuffers() {
+    glGenBuffers(ringSize, buffers.data());
+    for (int i = 0; i < ringSize; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, flags);
+            mapped[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, flags);
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    nextBuffer = 0;
+
+    if (persistent && std::find(mapped.begin(), mapped.end(), nullptr) != mapped.end()) {
+        // driver refused the persistent mapping, fall back to orphaned buffers
+        destroyBuffers();
+        bufferSize = (size_t)width * height * sizeof(colour8);
+        persistent = false;
+        createBuffers();
+    }
+}
+
+void TextureStreamer::destroyBuffers() {
+    if (bufferSize == 0) return;
+    for (int i = 0; i < ringSize; i++) {
+        if (fences[i]) glDeleteSync(fences[i]);
+        fences[i] = nullptr;
+        if (mapped[i]) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            mapped[i] = nullptr;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(ringSize, buffers.data());
+    bufferSize = 0;
+}
+
+// newly finished tiles, merged into horizontal runs per tile row and then stacked
+// vertically where consecutive rows have identical runs
+std::vector<TextureStreamer::DirtyRect> TextureStreamer::collectDirtyRects(const Frame& frame) {
+    std::vector<bool> fresh(shownTiles.size(), false);
+    for (int word = 0; word < frame.numTileWords(); word++) {
+        uint64_t done = frame.tileDoneWord(word);
+        while (done != 0) {
+            int tile = word * 64 + std::countr_zero(done);
+            done &= done - 1;
+            if (!shownTiles[tile]) {
+                shownTiles[tile] = true;
+                fresh[tile] = true;
+            }
+        }
+    }
+
+    std::vector<DirtyRect> rects;
+    std::vector<size_t> previousRow;
+    for (int ty = 0; ty < frame.tilesY; ty++) {
+        std::vector<size_t> currentRow;
+        for (int tx = 0; tx < frame.tilesX; tx++) {
+            if (!fresh[ty * frame.tilesX + tx]) continue;
+            int runStart = tx;
+            while (tx + 1 < frame.tilesX && fresh[ty * frame.tilesX + tx + 1]) tx++;
+            DirtyRect rect = {runStart * Frame::tileSize, ty * Frame::tileSize,
+                              (tx + 1) * Frame::tileSize - runStart * Frame::tileSize, frame.tileHeight(ty)};
+            rect.width = std::min(rect.width, frame.width - rect.x);
+
+            auto above = std::find_if(previousRow.begin(), previousRow.end(), [&](size_t i) {
+                return rects[i].x == rect.x && rects[i].width == rect.width;
+            });
+            if (above != previousRow.end()) {
+                rects[*above].height += rect.height;
+                currentRow.push_back(*above);
+            } else {
+                currentRow.push_back(rects.size());
+                rects.push_back(rect);
+            }
+        }
+        previousRow = std::move(currentRow);
+    }
+    return rects;
+}
+
+void TextureStreamer::upload(const colour8* source, int stride, const std::vector<DirtyRect>& rects) {
+    int index = nextBuffer;
+    nextBuffer = (nextBuffer + 1) % ringSize;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index]);
+    void* destination;
+    if (persistent) {
+        // the gpu may still be reading this buffer from ringSize updates ago
+        if (fences[index]) {
+            glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fences[index]);
+            fences[index] = nullptr;
+        }
+        destination = mapped[index];
+    } else {
+        // orphan the old storage instead of waiting for the gpu to finish with it
+        destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    // pack each rectangle tightly, one after the other
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+    for (const DirtyRect& rect : rects) {
+        offsets.push_back(offset);
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            std::memcpy((char*)destination + offset, source + y * stride + rect.x, rect.width * sizeof(colour8));
+            offset += rect.width * sizeof(colour8);
+        }
+    }
+    if (!persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (size_t i = 0; i < rects.size(); i++) {
+        const DirtyRect& rect = rects[i];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (void*)offsets[i]);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (persistent) fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,58 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "../src/glad/glad.h"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "frameBuffer.h"
+
+// keeps a texture in sync with the newest Frame by uploading only the tiles that finished
+// since the last update. the texture storage is specified once per size, tiles are merged
+// into dirty rectangles and streamed through a ring of pixel buffer objects with
+// glTexSubImage2D; the buffers are persistently mapped when the context has GL 4.4
+class TextureStreamer {
+public:
+    explicit TextureStreamer(unsigned int texture);
+
+    // frees the pixel buffers, must run while the gl context is still current
+    void release();
+
+    // returns true if the texture changed, false when there was nothing new to upload
+    bool update(const std::shared_ptr<const Frame>& frame);
+
+private:
+    struct DirtyRect {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    static constexpr int ringSize = 3;
+
+    void resize(int newWidth, int newHeight);
+    void createBuffers();
+    void destroyBuffers();
+    std::vector<DirtyRect> collectDirtyRects(const Frame& frame);
+    void upload(const colour8* source, int stride, const std::vector<DirtyRect>& rects);
+
+    unsigned int texture;
+    int width = 0;
+    int height = 0;
+
+    std::shared_ptr<const Frame> shownFrame;
+    std::vector<bool> shownTiles;
+    long long unsigned int shownGeneration = 0;
+    long long unsigned int shownPreview = 0;
+
+    bool persistent;
+    size_t bufferSize = 0;
+    int nextBuffer = 0;
+    std::array<unsigned int, ringSize> buffers{};
+    std::array<void*, ringSize> mapped{};
+    std::array<GLsync, ringSize> fences{};
+};
+
+#endif
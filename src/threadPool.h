@@ -1,23 +1,75 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <iomanip>
+#include <iostream>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <queue>
+#include <sstream>
 #include <thread>
 #include <tuple>
 #include <vector>
 
+// log2-bucketed duration histogram, bucket 0 is < 1us and bucket k covers [2^(k-1), 2^k) us
+struct DurationHistogram {
+    static constexpr size_t numBuckets = 40;
+    std::array<uint64_t, numBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+
+    // upper bound of the bucket holding the q-th quantile, in microseconds
+    double percentileUs(double q) const {
+        if (count == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, std::ceil(q * count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < numBuckets; i++) {
+            seen += buckets[i];
+            if (seen >= target) return std::ldexp(1.0, i);
+        }
+        return std::ldexp(1.0, numBuckets);
+    }
+
+    double meanUs() const {
+        return count == 0 ? 0 : totalNs / 1000.0 / count;
+    }
+};
+
+struct ThreadPoolMetrics {
+    struct Worker {
+        uint64_t busyNs;
+        uint64_t idleNs;
+        uint64_t tasksExecuted;
+    };
+    std::vector<Worker> workers;
+    DurationHistogram queueLatency; // enqueue to start of execution
+    DurationHistogram runTime;
+    uint64_t tasksEnqueued;
+    uint64_t tasksPurged;
+    size_t queueSize;
+    size_t busyThreads;
+};
+
 class ThreadPool {
 public:
     explicit ThreadPool(size_t numThreads) 
         : shutdownRequested(false)
-        , busyThreads(0) {
+        , busyThreads(0)
+        , workerStats(numThreads) {
         try {
             for (size_t i = 0; i < numThreads; ++i) {
-                threads.emplace_back(&ThreadPool::workerFunction, this);
+                threads.emplace_back(&ThreadPool::workerFunction, this, i);
             }
         } catch (...) {
             shutdown();
@@ -45,7 +97,9 @@ public:
             if (shutdownRequested) {
                 //throw std::runtime_error("Cannot add tasks to a stopped ThreadPool");
             } else {
-                tasks.emplace(taskPriority, [task]() { (*task)(); });
+                tasks.push({taskPriority, [task]() { (*task)(); }, std::chrono::steady_clock::now()});
+                queuedTasks.store(tasks.size(), std::memory_order_relaxed);
+                tasksEnqueued.fetch_add(1, std::memory_order_relaxed);
             }
         }
 
@@ -59,6 +113,10 @@ public:
             shutdownRequested = true;
         }
         conditionVariable.notify_all();
+        dumpConditionVariable.notify_all();
+        if (dumpThread.joinable()) {
+            dumpThread.join();
+        }
         
         for (std::thread& worker : threads) {
             if (worker.joinable()) {
@@ -68,8 +126,7 @@ public:
     }
 
     size_t getNumBusyThreads() const {
-        std::lock_guard<std::mutex> lock(mutex);
-        return busyThreads.load();
+        return busyThreads.load(std::memory_order_relaxed);
     }
 
     size_t getNumThreads() const {
@@ -78,36 +135,136 @@ public:
     }
 
     long getQueueSize() const {
-        std::lock_guard<std::mutex> lock(mutex);
-        return tasks.size();
+        return queuedTasks.load(std::memory_order_relaxed);
     }
 
     void purge() {
         std::lock_guard<std::mutex> lock(mutex);
-        for (int i = 0; i < tasks.size(); i++) {
+        while (!tasks.empty()) {
             tasks.pop();
+            tasksPurged.fetch_add(1, std::memory_order_relaxed);
+        }
+        queuedTasks.store(tasks.size(), std::memory_order_relaxed);
+    }
+
+    // relaxed snapshot of the counters, cheap enough to call every frame
+    ThreadPoolMetrics getMetrics() const {
+        ThreadPoolMetrics metrics;
+        metrics.workers.reserve(workerStats.size());
+        for (const WorkerStats& stats : workerStats) {
+            metrics.workers.push_back({
+                stats.busyNs.load(std::memory_order_relaxed),
+                stats.idleNs.load(std::memory_order_relaxed),
+                stats.tasksExecuted.load(std::memory_order_relaxed)
+            });
+        }
+        queueLatency.snapshot(metrics.queueLatency);
+        runTime.snapshot(metrics.runTime);
+        metrics.tasksEnqueued = tasksEnqueued.load(std::memory_order_relaxed);
+        metrics.tasksPurged = tasksPurged.load(std::memory_order_relaxed);
+        metrics.queueSize = queuedTasks.load(std::memory_order_relaxed);
+        metrics.busyThreads = busyThreads.load(std::memory_order_relaxed);
+        return metrics;
+    }
+
+    // print a summary of the metrics every interval until the pool shuts down
+    void startMetricsDump(std::chrono::milliseconds interval, std::ostream& out = std::cout) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dumpThread.joinable() || shutdownRequested) return;
+        dumpThread = std::thread([this, interval, &out]() {
+            ThreadPoolMetrics previous = getMetrics();
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!dumpConditionVariable.wait_for(lock, interval, [this] { return shutdownRequested; })) {
+                lock.unlock();
+                ThreadPoolMetrics current = getMetrics();
+                printMetrics(out, current, previous);
+                previous = std::move(current);
+                lock.lock();
+            }
+        });
+    }
+
+    // busy percentages are computed over the interval between the two snapshots
+    static void printMetrics(std::ostream& out, const ThreadPoolMetrics& current, const ThreadPoolMetrics& previous) {
+        uint64_t busyNs = 0, idleNs = 0, tasksRun = 0;
+        for (size_t i = 0; i < current.workers.size(); i++) {
+            busyNs += current.workers[i].busyNs - previous.workers[i].busyNs;
+            idleNs += current.workers[i].idleNs - previous.workers[i].idleNs;
+            tasksRun += current.workers[i].tasksExecuted - previous.workers[i].tasksExecuted;
         }
+        double busyPct = busyNs + idleNs == 0 ? 0 : 100.0 * busyNs / (busyNs + idleNs);
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1)
+            << "pool: " << current.workers.size() << " workers, " << busyPct << "% busy, "
+            << tasksRun << " tasks run, " << current.queueSize << " queued, "
+            << current.tasksPurged - previous.tasksPurged << " purged | "
+            << "queue latency us p50 " << current.queueLatency.percentileUs(0.5)
+            << " p99 " << current.queueLatency.percentileUs(0.99)
+            << " | run time us mean " << current.runTime.meanUs()
+            << " p50 " << current.runTime.percentileUs(0.5)
+            << " p99 " << current.runTime.percentileUs(0.99) << "\n";
+        out << line.str();
     }
 
 private:
+    // longest stretch of idle time a worker holds back from the metrics
+    static constexpr std::chrono::milliseconds idleFlushInterval{50};
+
     struct TaskItem {
         int priority;
         std::function<void()> task;
+        std::chrono::steady_clock::time_point enqueued;
 
         bool operator<(const TaskItem& other) const {
             return priority < other.priority;  // Higher priority first
         }
     };
 
-    void workerFunction() {
+    // lock-free histogram updated by the workers
+    struct AtomicHistogram {
+        std::array<std::atomic<uint64_t>, DurationHistogram::numBuckets> buckets{};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalNs{0};
+
+        void record(std::chrono::nanoseconds duration) {
+            uint64_t ns = std::max<int64_t>(0, duration.count());
+            size_t bucket = std::min<size_t>(std::bit_width(ns / 1000), DurationHistogram::numBuckets - 1);
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            totalNs.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void snapshot(DurationHistogram& out) const {
+            for (size_t i = 0; i < buckets.size(); i++) {
+                out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+            out.count = count.load(std::memory_order_relaxed);
+            out.totalNs = totalNs.load(std::memory_order_relaxed);
+        }
+    };
+
+    // one cache line per worker so the counters don't false-share
+    struct alignas(64) WorkerStats {
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> idleNs{0};
+        std::atomic<uint64_t> tasksExecuted{0};
+    };
+
+    void workerFunction(size_t index) {
+        WorkerStats& stats = workerStats[index];
+        auto idleSince = std::chrono::steady_clock::now();
         for (;;) {
             TaskItem task;
             
             {
                 std::unique_lock<std::mutex> lock(mutex);
-                conditionVariable.wait(lock, [this] {
-                    return shutdownRequested || !tasks.empty();
-                });
+                while (!shutdownRequested && tasks.empty()) {
+                    conditionVariable.wait_for(lock, idleFlushInterval);
+                    // counted as it passes, a worker idle for a whole dump interval shows up in it
+                    auto now = std::chrono::steady_clock::now();
+                    stats.idleNs.fetch_add((now - idleSince).count(), std::memory_order_relaxed);
+                    idleSince = now;
+                }
                 
                 if (shutdownRequested && tasks.empty()) {
                     return;
@@ -115,11 +272,21 @@ private:
                 
                 task = std::move(tasks.top());
                 tasks.pop();
+                queuedTasks.store(tasks.size(), std::memory_order_relaxed);
             }
             
+            auto start = std::chrono::steady_clock::now();
+            stats.idleNs.fetch_add((start - idleSince).count(), std::memory_order_relaxed);
+            queueLatency.record(start - task.enqueued);
+
             busyThreads++;
             task.task();
             busyThreads--;
+
+            idleSince = std::chrono::steady_clock::now();
+            stats.busyNs.fetch_add((idleSince - start).count(), std::memory_order_relaxed);
+            stats.tasksExecuted.fetch_add(1, std::memory_order_relaxed);
+            runTime.record(idleSince - start);
         }
     }
 
@@ -130,4 +297,16 @@ private:
     std::condition_variable conditionVariable;
     bool shutdownRequested;
     std::atomic<size_t> busyThreads;
-};
\ No newline at end of file
+
+    std::vector<WorkerStats> workerStats;
+    AtomicHistogram queueLatency;
+    AtomicHistogram runTime;
+    std::atomic<uint64_t> tasksEnqueued{0};
+    std::atomic<uint64_t> tasksPurged{0};
+    std::atomic<size_t> queuedTasks{0};
+
+    std::thread dumpThread;
+    std::condition_variable dumpConditionVariable;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "tileCache.h"
+#include <algorithm>
+#include <cmath>
+#include "frameBuffer.h"
+
+namespace {
+
+// 15 significant digits, far below anything visible but enough to keep levels apart
+const int zoomDigits = 15;
+
+std::string zoomString(const mpf_class& zoom) {
+    mp_exp_t exponent;
+    std::string digits = zoom.get_str(exponent, 10, zoomDigits);
+    return "0." + digits + "e" + std::to_string(exponent);
+}
+
+// lattice index of the view's pixel 0, round(offset / pixelSize - size / 2)
+bool latticeOrigin(const mpf_class& offset, const mpf_class& pixelSize, int size, unsigned long precision, mpz_class& origin) {
+    mpf_class position(offset / pixelSize - size / 2.0, precision);
+    mpf_class rounded(floor(position + 0.5), precision);
+    origin = mpz_class(rounded);
+    return std::abs(mpf_class(position - rounded).get_d()) < 1e-3;
+}
+
+}
+
+void snapToLattice(ViewSnapshot& view) {
+    view.zoom = mpf_class(zoomString(view.zoom), view.precision);
+    mpf_class pixelSize(view.zoom / view.sizex, view.precision);
+    mpz_class originX, originY;
+    latticeOrigin(view.offsetx, pixelSize, view.sizex, view.precision, originX);
+    latticeOrigin(view.offsety, pixelSize, view.sizey, view.precision, originY);
+    view.offsetx = mpf_class((mpf_class(originX, view.precision) + view.sizex / 2.0) * pixelSize, view.precision);
+    view.offsety = mpf_class((mpf_class(originY, view.precision) + view.sizey / 2.0) * pixelSize, view.precision);
+}
+
+TileCache::TileCache(size_t maxBytes, const std::string& diskPath, size_t maxDiskBytes)
+    : maxTiles(std::max<size_t>(1, maxBytes / (tileSize * tileSize * sizeof(MandelSample)))) {
+    if (!diskPath.empty()) {
+        disk = std::make_unique<DiskTileCache>(diskPath, maxDiskBytes);
+        if (!disk->isOpen()) disk.reset();
+    }
+}
+
+bool TileCache::place(const ViewSnapshot& view, Placement& placement) {
+    // the zoom has to be canonical too, otherwise the same level would get different keys
+    if (cmp(view.zoom, mpf_class(zoomString(view.zoom), view.precision)) != 0) return false;
+    mpf_class pixelSize(view.zoom / view.sizex, view.precision);
+    mpz_class originX, originY;
+    if (!latticeOrigin(view.offsetx, pixelSize, view.sizex, view.precision, originX)) return false;
+    if (!latticeOrigin(view.offsety, pixelSize, view.sizey, view.precision, originY)) return false;
+
+    // samples don't depend on the colouring, but guessed ones depend on the algorithm and the fill modes
+    placement.levelKey = zoomString(view.zoom) + "/" + std::to_string(view.sizex) + "/" + std::to_string(view.maxIter)
+                       + "/" + std::to_string((int)view.algorithm) + "/" + std::to_string(view.accurateColouring)
+                       + "/" + std::to_string(usePerturbation(view)) + "/" + std::to_string(view.distanceEstimation)
+                       + "/" + std::to_string(view.certifiedFill) + "/";
+    mpz_class remainder;
+    mpz_fdiv_qr_ui(placement.firstTileX.get_mpz_t(), remainder.get_mpz_t(), originX.get_mpz_t(), tileSize);
+    placement.originX = -(int)remainder.get_si();
+    mpz_fdiv_qr_ui(placement.firstTileY.get_mpz_t(), remainder.get_mpz_t(), originY.get_mpz_t(), tileSize);
+    placement.originY = -(int)remainder.get_si();
+    placement.tilesX = (view.sizex - placement.originX + tileSize - 1) / tileSize;
+    placement.tilesY = (view.sizey - placement.originY + tileSize - 1) / tileSize;
+    return true;
+}
+
+std::string TileCache::tileKey(const Placement& placement, int tx, int ty) {
+    mpz_class x = placement.firstTileX + tx;
+    mpz_class y = placement.firstTileY + ty;
+    return placement.levelKey + x.get_str(36) + "," + y.get_str(36);
+}
+
+TileCache::Tile* TileCache::find(const std::string& key) {
+    auto it = index.find(key);
+    if (it == index.end()) return nullptr;
+    tiles.splice(tiles.begin(), tiles, it->second);
+    return &tiles.front();
+}
+
+void TileCache::evict() {
+    while (tiles.size() > maxTiles) {
+        index.erase(tiles.back().key);
+        tiles.pop_back();
+    }
+}
+
+std::vector<ScreenRect> TileCache::serve(MandelJob& job, const std::vector<ScreenRect>& regions) {
+    Placement placement;
+    if (!place(job.view, placement)) return regions;
+
+    Frame& frame = *job.frame;
+    std::vector<ScreenRect> remaining;
+    for (const ScreenRect& region : regions) {
+        for (int ty = 0; ty < placement.tilesY; ty++) {
+            int tileY0 = placement.originY + ty * tileSize;
+            int y0 = std::max(region.y0, tileY0), y1 = std::min(region.y1, tileY0 + tileSize);
+            if (y0 >= y1) continue;
+            for (int tx = 0; tx < placement.tilesX; tx++) {
+                int tileX0 = placement.originX + tx * tileSize;
+                int x0 = std::max(region.x0, tileX0), x1 = std::min(region.x1, tileX0 + tileSize);
+                if (x0 >= x1) continue;
+
+                std::string key = tileKey(placement, tx, ty);
+                Tile* tile = find(key);
+                const MandelSample* samples = tile ? tile->samples.data() : nullptr;
+                for (int y = y0; y < y1 && samples; y++) {
+                    for (int x = x0; x < x1 && samples; x++) {
+                        if (!tile->known[(y - tileY0) * tileSize + x - tileX0]) samples = nullptr;
+                    }
+                }
+                // straight out of the file mapping, disk tiles are always complete
+                if (!samples && disk) samples = disk->find(key, tileSize * tileSize);
+                if (!samples) {
+                    // runs of missed tiles along a row become one rectangle
+                    if (!remaining.empty() && remaining.back().y0 == y0 && remaining.back().y1 == y1 && remaining.back().x1 == x0) {
+                        remaining.back().x1 = x1;
+                    } else {
+                        remaining.push_back({x0, y0, x1, y1});
+                    }
+                    continue;
+                }
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        storeSample(job, x, y, samples[(y - tileY0) * tileSize + x - tileX0]);
+                    }
+                }
+                frame.markFinal(x0, y0, x1, y1);
+            }
+        }
+    }
+    return remaining;
+}
+
+void TileCache::insert(const MandelJob& job) {
+    Placement placement;
+    if (!place(job.view, placement)) return;
+
+    const Frame& frame = *job.frame;
+    for (int ty = 0; ty < placement.tilesY; ty++) {
+        int tileY0 = placement.originY + ty * tileSize;
+        int y0 = std::max(0, tileY0), y1 = std::min(frame.height, tileY0 + tileSize);
+        for (int tx = 0; tx < placement.tilesX; tx++) {
+            int tileX0 = placement.originX + tx * tileSize;
+            int x0 = std::max(0, tileX0), x1 = std::min(frame.width, tileX0 + tileSize);
+
+            std::string key = tileKey(placement, tx, ty);
+            Tile* tile = find(key);
+            if (!tile) {
+                tiles.push_front({key, std::vector<MandelSample>(tileSize * tileSize), std::vector<bool>(tileSize * tileSize, false)});
+                index[key] = tiles.begin();
+                tile = &tiles.front();
+            }
+            if (tile->knownCount == tileSize * tileSize) continue;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    int i = (y - tileY0) * tileSize + x - tileX0;
+                    tile->samples[i] = frame.samples[y * frame.width + x];
+                    if (!tile->known[i]) {
+                        tile->known[i] = true;
+                        tile->knownCount++;
+                    }
+                }
+            }
+            if (disk && tile->knownCount == tileSize * tileSize && !disk->contains(key)) {
+                disk->append(key, tile->samples);
+            }
+        }
+    }
+    evict();
+}
@@ -0,0 +1,65 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "main.h"
+#include "diskTileCache.h"
+
+// round the zoom to a canonical value and move the offsets onto the pixel lattice of that
+// zoom, i.e. pixel (x, y) sits at (kx + x, ky + y) * zoom / sizex for whole kx, ky. the view
+// moves by less than half a pixel, in exchange tiles of different frames at the same zoom line up
+void snapToLattice(ViewSnapshot& view);
+
+// bounded LRU cache of rendered samples, organised like map tiles: per zoom level the
+// plane is cut into tileSize x tileSize pixel tiles on the lattice grid, keyed by the exact
+// tile index and everything the samples depend on. tiles partly off screen are cached as
+// far as they were seen. complete tiles are also written to the disk cache if there is
+// one, which is consulted when memory misses. only used from the render coordinator thread
+class TileCache {
+public:
+    static constexpr int tileSize = 64;
+
+    // an empty diskPath keeps the cache in memory only
+    TileCache(size_t maxBytes, const std::string& diskPath, size_t maxDiskBytes);
+
+    // fills every part of regions that is fully cached, marks it final and returns the rest
+    std::vector<ScreenRect> serve(MandelJob& job, const std::vector<ScreenRect>& regions);
+    // stores the samples of a completed frame
+    void insert(const MandelJob& job);
+
+private:
+    struct Tile {
+        std::string key;
+        std::vector<MandelSample> samples;
+        std::vector<bool> known;
+        int knownCount = 0;
+    };
+
+    // where the view's pixel grid sits among the tiles, false if it isn't on the lattice
+    struct Placement {
+        std::string levelKey;
+        mpz_class firstTileX;
+        mpz_class firstTileY;
+        int originX; // screen position of the first tile's corner, <= 0
+        int originY;
+        int tilesX;
+        int tilesY;
+    };
+
+    static bool place(const ViewSnapshot& view, Placement& placement);
+    static std::string tileKey(const Placement& placement, int tx, int ty);
+    Tile* find(const std::string& key);
+    void evict();
+
+    size_t maxTiles;
+    std::unique_ptr<DiskTileCache> disk;
+    std::list<Tile> tiles; // most recently used first
+    std::unordered_map<std::string, std::list<Tile>::iterator> index;
+};
+
+#endif
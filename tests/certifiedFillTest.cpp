@@ -0,0 +1,61 @@
+// the test target renames the app's main, this is the entry point
+#undef main
+#include <iostream>
+#include "../src/main.h"
+
+void runGraphicsEngine() {}
+
+namespace {
+
+// what computeMandelPosition reports for pixel (x, y) of the view
+long long kernelIter(const ViewSnapshot& view, int x, int y) {
+    mpf_t cr, ci, temp;
+    mpf_init2(cr, view.precision);
+    mpf_init2(ci, view.precision);
+    mpf_init2(temp, view.precision);
+    pixelPosition(view, x, y, cr, ci, temp);
+    long long iter = computeMandelPosition(cr, ci, view.maxIter, view.precision, nullptr, nullptr).iter;
+    mpf_clear(temp);
+    mpf_clear(ci);
+    mpf_clear(cr);
+    return iter;
+}
+
+// every pixel of the rect has to escape at the same iteration for the test to mean anything
+long long uniformIter(const ViewSnapshot& view, int x0, int y0, int x1, int y1) {
+    long long first = kernelIter(view, x0, y0);
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (kernelIter(view, x, y) != first) return -1;
+        }
+    }
+    return first;
+}
+
+bool check(const char* name, const ViewSnapshot& view, int x0, int y0, int x1, int y1) {
+    long long expected = uniformIter(view, x0, y0, x1, y1);
+    long long certified = certifyRect(view, x0, y0, x1, y1);
+    bool ok = expected >= 0 && certified == expected;
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": kernel " << expected << ", certified " << certified << std::endl;
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    unsigned long precision = 64;
+    ViewSnapshot view{64, 64, 1000, 0.01, true, precision, mpf_class(0, precision), mpf_class(0, precision),
+                      mpf_class(0.01, precision)};
+    bool ok = true;
+    // escape bands well away from the set, each rect inside one of them
+    for (auto [r, i] : {std::pair{-2.2, 0.0}, std::pair{0.6, 0.6}, std::pair{-0.4, 1.1}}) {
+        view.offsetx = r;
+        view.offsety = i;
+        ok &= check("escape band", view, 28, 28, 36, 36);
+    }
+    // inside the main cardioid nothing escapes
+    view.offsetx = -0.1;
+    view.offsety = 0.1;
+    ok &= check("interior", view, 16, 16, 48, 48);
+    return ok ? 0 : 1;
+}